@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 
 #include "buffer_mgr.h"
 #include "storage_mgr.h"
@@ -19,8 +20,21 @@ typedef struct Frame {
     int histIdx;
     char *data;
     struct Frame *next;
+    struct LFUBucket *bucket;      // RS_LFU frequency bucket
+    struct Frame *bucketPrev;
+    struct Frame *bucketNext;
 } Frame;
 
+// RS_LFU frequency bucket: the frames referenced freq times, most recently
+// used at head. Buckets are kept in ascending order of freq.
+typedef struct LFUBucket {
+    int freq;
+    Frame *head;
+    Frame *tail;
+    struct LFUBucket *prev;
+    struct LFUBucket *next;
+} LFUBucket;
+
 // Management metadata for buffer pool
 typedef struct BM_MgmtData {
     Frame *frames;
@@ -30,20 +44,134 @@ typedef struct BM_MgmtData {
     int numWriteIO;
     int timestamp;
     SM_FileHandle fileHandle;
+    LFUBucket *lfuFirst;
+    int lfuDecayInterval;
+    int lfuSinceDecay;
 } BM_MgmtData;
 
-static Frame *createFrame() {
-    Frame *frame = (Frame *)malloc(sizeof(Frame));
+// Frames, their histories and their page data are carved out of three
+// allocations made once per pool; data is a page-aligned arena with one
+// PAGE_SIZE block per frame.
+static void initFrame(Frame *frame, int *history, char *data) {
     frame->pageNum = NO_PAGE;
     frame->fixCount = 0;
     frame->isDirty = false;
     frame->referenceBit = false;
     frame->lastUsed = 0;
-    frame->history = (int *)calloc(K_VAL, sizeof(int));
+    frame->history = history;
     frame->histIdx = 0;
-    frame->data = (char *)calloc(PAGE_SIZE, sizeof(char));
+    frame->data = data;
     frame->next = NULL;
-    return frame;
+    frame->bucket = NULL;
+    frame->bucketPrev = NULL;
+    frame->bucketNext = NULL;
+}
+
+// LFU with constant-time frequency buckets. Every frame sits in the bucket
+// for its reference count (empty frames in bucket 0); a hit moves it to the
+// next bucket and the victim is the least recently used unpinned frame of
+// the lowest bucket.
+static LFUBucket *lfuNewBucket(BM_MgmtData *mgmtData, int freq, LFUBucket *after) {
+    LFUBucket *bucket = (LFUBucket *)malloc(sizeof(LFUBucket));
+    bucket->freq = freq;
+    bucket->head = NULL;
+    bucket->tail = NULL;
+    bucket->prev = after;
+    bucket->next = after ? after->next : mgmtData->lfuFirst;
+    if (bucket->next) bucket->next->prev = bucket;
+    if (after) after->next = bucket;
+    else mgmtData->lfuFirst = bucket;
+    return bucket;
+}
+
+static void lfuFreeIfEmpty(BM_MgmtData *mgmtData, LFUBucket *bucket) {
+    if (bucket->head != NULL) return;
+    if (bucket->prev) bucket->prev->next = bucket->next;
+    else mgmtData->lfuFirst = bucket->next;
+    if (bucket->next) bucket->next->prev = bucket->prev;
+    free(bucket);
+}
+
+static void lfuInsert(LFUBucket *bucket, Frame *frame, bool atHead) {
+    if (atHead) {
+        frame->bucketPrev = NULL;
+        frame->bucketNext = bucket->head;
+        if (bucket->head) bucket->head->bucketPrev = frame;
+        else bucket->tail = frame;
+        bucket->head = frame;
+    } else {
+        frame->bucketNext = NULL;
+        frame->bucketPrev = bucket->tail;
+        if (bucket->tail) bucket->tail->bucketNext = frame;
+        else bucket->head = frame;
+        bucket->tail = frame;
+    }
+    frame->bucket = bucket;
+}
+
+static void lfuRemove(Frame *frame) {
+    LFUBucket *bucket = frame->bucket;
+    if (frame->bucketPrev) frame->bucketPrev->bucketNext = frame->bucketNext;
+    else bucket->head = frame->bucketNext;
+    if (frame->bucketNext) frame->bucketNext->bucketPrev = frame->bucketPrev;
+    else bucket->tail = frame->bucketPrev;
+}
+
+// Move frame into the bucket for freq, searching forward from 'from'.
+static void lfuMove(BM_MgmtData *mgmtData, Frame *frame, int freq, LFUBucket *from, bool atHead) {
+    LFUBucket *old = frame->bucket;
+    LFUBucket *target = from ? from : mgmtData->lfuFirst;
+    LFUBucket *prev = from ? from->prev : NULL;
+    while (target && target->freq < freq) {
+        prev = target;
+        target = target->next;
+    }
+    if (target == NULL || target->freq != freq)
+        target = lfuNewBucket(mgmtData, freq, prev);
+
+    lfuRemove(frame);
+    lfuInsert(target, frame, atHead);
+    lfuFreeIfEmpty(mgmtData, old);
+}
+
+// Aging: halve every reference count. Buckets that collapse onto the same
+// count are spliced together with the hotter one at the head.
+static void lfuDecay(BM_MgmtData *mgmtData) {
+    LFUBucket *out = NULL;
+    LFUBucket *bucket = mgmtData->lfuFirst;
+    while (bucket) {
+        LFUBucket *next = bucket->next;
+        int freq = bucket->freq == 0 ? 0 : (bucket->freq / 2 > 0 ? bucket->freq / 2 : 1);
+
+        if (out && out->freq == freq) {
+            for (Frame *f = bucket->head; f; f = f->bucketNext)
+                f->bucket = out;
+            bucket->tail->bucketNext = out->head;
+            out->head->bucketPrev = bucket->tail;
+            out->head = bucket->head;
+            bucket->head = NULL;
+            lfuFreeIfEmpty(mgmtData, bucket);
+        } else {
+            bucket->freq = freq;
+            out = bucket;
+        }
+        bucket = next;
+    }
+    mgmtData->lfuSinceDecay = 0;
+}
+
+static void lfuCounted(BM_MgmtData *mgmtData) {
+    if (mgmtData->lfuDecayInterval > 0 && ++mgmtData->lfuSinceDecay >= mgmtData->lfuDecayInterval)
+        lfuDecay(mgmtData);
+}
+
+static Frame *selectVictimLFU(BM_MgmtData *mgmtData) {
+    for (LFUBucket *bucket = mgmtData->lfuFirst; bucket; bucket = bucket->next) {
+        for (Frame *f = bucket->tail; f; f = f->bucketPrev) {
+            if (f->fixCount == 0) return f;
+        }
+    }
+    return NULL;
 }
 
 
@@ -88,13 +216,25 @@ RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName,
     RC rc = openPageFile((char *)pageFileName, &mgmtData->fileHandle);
     if (rc != RC_OK) return rc;
 
-    Frame *head = createFrame();
-    Frame *curr = head;
-    for (int i = 1; i < numPages; i++) {
-        curr->next = createFrame();
-        curr = curr->next;
+    void *arena = NULL;
+    Frame *head = (Frame *)malloc(sizeof(Frame) * numPages);
+    int *histories = (int *)calloc((size_t)numPages * K_VAL, sizeof(int));
+    if (head == NULL || histories == NULL ||
+        posix_memalign(&arena, PAGE_SIZE, (size_t)numPages * PAGE_SIZE) != 0) {
+        free(head);
+        free(histories);
+        closePageFile(&mgmtData->fileHandle);
+        free(mgmtData);
+        return RC_MEMORY_ALLOCATION_ERROR;
     }
-    curr->next = head;
+    memset(arena, 0, (size_t)numPages * PAGE_SIZE);
+
+    // the frames still form a ring, in array order
+    for (int i = 0; i < numPages; i++) {
+        initFrame(&head[i], histories + (size_t)i * K_VAL, (char *)arena + (size_t)i * PAGE_SIZE);
+        head[i].next = &head[(i + 1) % numPages];
+    }
+    Frame *curr = head;
 
     mgmtData->frames = head;
     mgmtData->clockHand = head;
@@ -103,6 +243,20 @@ RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName,
     mgmtData->numWriteIO = 0;
     mgmtData->timestamp = 0;
 
+    mgmtData->lfuFirst = NULL;
+    mgmtData->lfuDecayInterval = 0;
+    mgmtData->lfuSinceDecay = 0;
+    if (strategy == RS_LFU) {
+        LFUBucket *zero = lfuNewBucket(mgmtData, 0, NULL);
+        curr = head;
+        do {
+            lfuInsert(zero, curr, true);
+            curr = curr->next;
+        } while (curr != head);
+        if (stratData != NULL)
+            mgmtData->lfuDecayInterval = ((BM_LFUParams *)stratData)->decayInterval;
+    }
+
     bm->pageFile = strdup(pageFileName);
     bm->numPages = numPages;
     bm->strategy = strategy;
@@ -114,15 +268,14 @@ RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName,
 RC shutdownBufferPool(BM_BufferPool *const bm) {
     BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
     forceFlushPool(bm);
-    Frame *curr = mgmtData->frames;
-    Frame *start = curr;
-    do {
-        Frame *temp = curr->next;
-        free(curr->data);
-        free(curr->history);
-        free(curr);
-        curr = temp;
-    } while (curr != start);
+    free(mgmtData->frames[0].data);
+    free(mgmtData->frames[0].history);
+    free(mgmtData->frames);
+    while (mgmtData->lfuFirst) {
+        LFUBucket *next = mgmtData->lfuFirst->next;
+        free(mgmtData->lfuFirst);
+        mgmtData->lfuFirst = next;
+    }
     closePageFile(&mgmtData->fileHandle);
     free(mgmtData);
     free(bm->pageFile);
@@ -199,6 +352,10 @@ RC pinPage(BM_BufferPool *const bm, BM_PageHandle *const page,
             curr->lastUsed = ++mgmtData->timestamp;
             curr->history[curr->histIdx % K_VAL] = mgmtData->timestamp;
             curr->histIdx++;
+            if (bm->strategy == RS_LFU) {
+                lfuMove(mgmtData, curr, curr->bucket->freq + 1, curr->bucket, true);
+                lfuCounted(mgmtData);
+            }
             page->pageNum = pageNum;
             page->data = curr->data;
             return RC_OK;
@@ -271,6 +428,8 @@ RC pinPage(BM_BufferPool *const bm, BM_PageHandle *const page,
                 ptr = ptr->next;
             } while (ptr != mgmtData->frames);
         }
+    } else if (bm->strategy == RS_LFU) {
+        victim = selectVictimLFU(mgmtData);
     }
 
     if (victim == NULL) return RC_BUFFER_POOL_FULL;
@@ -302,6 +461,9 @@ RC pinPage(BM_BufferPool *const bm, BM_PageHandle *const page,
 
     if (bm->strategy == RS_FIFO) {
         mgmtData->fifoPtr = victim->next;
+    } else if (bm->strategy == RS_LFU) {
+        lfuMove(mgmtData, victim, 1, NULL, true);
+        lfuCounted(mgmtData);
     }
 
     return RC_OK;
@@ -35,6 +35,11 @@ typedef struct BM_PageHandle {
 	char *data;
 } BM_PageHandle;
 
+// Strategy parameters for RS_LFU, passed as stratData (NULL = no aging).
+typedef struct BM_LFUParams {
+	int decayInterval; // halve all reference counts every decayInterval pins (0 = never)
+} BM_LFUParams;
+
 // convenience macros
 #define MAKE_POOL()					\
 		((BM_BufferPool *) malloc (sizeof(BM_BufferPool)))
@@ -33,6 +33,8 @@ static void createDummyPages(BM_BufferPool *bm, int num);
 
 static void testLRU_K (void);
 
+static void testLFU (void);
+
 static void testError (void);
 
 // main method
@@ -42,6 +44,7 @@ main (void)
     initStorageManager();
     testName = "";
     
+    testLFU();
     testLRU_K();
     testError();
     return 0;
@@ -144,6 +147,93 @@ testLRU_K (void)
 }
 
 
+// test the LFU page replacement strategy
+void
+testLFU (void)
+{
+    // expected results
+    const char *poolContents[] = {
+        // read first three pages and directly unpin them
+        "[0 0],[-1 0],[-1 0]",
+        "[0 0],[1 0],[-1 0]",
+        "[0 0],[1 0],[2 0]",
+        // reuse pages to give them different reference counts
+        "[0 0],[1 0],[2 0]",
+        "[0 0],[1 0],[2 0]",
+        "[0 0],[1 0],[2 0]",
+        // the least frequently used page goes first, ties by recency
+        "[0 0],[1 0],[3 0]",
+        "[0 0],[1 0],[3 0]",
+        "[0 0],[4 0],[3 0]",
+        "[0 0],[5 0],[3 0]"
+    };
+    const int requests[] = {0,1,2,0,0,1,3,3,4,5};
+    const int numRequests = 10;
+
+    int i;
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    testName = "Testing LFU page replacement";
+
+    CHECK(createPageFile("testbuffer.bin"));
+    createDummyPages(bm, 100);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_LFU, NULL));
+
+    for(i = 0; i < numRequests; i++)
+    {
+        pinPage(bm, h, requests[i]);
+        unpinPage(bm, h);
+        ASSERT_EQUALS_POOL(poolContents[i], bm, "check pool content using pages");
+    }
+
+    // check number of write IOs
+    ASSERT_EQUALS_INT(0, getNumWriteIO(bm), "check number of write I/Os");
+    ASSERT_EQUALS_INT(6, getNumReadIO(bm), "check number of read I/Os");
+
+    CHECK(shutdownBufferPool(bm));
+
+    // with aging every sixth pin halves the reference counts, so page 0 loses
+    // the lead its four early pins gave it and goes before page 3
+    const char *agingContents[] = {
+        "[0 0],[-1 0],[-1 0]",
+        "[0 0],[-1 0],[-1 0]",
+        "[0 0],[-1 0],[-1 0]",
+        "[0 0],[-1 0],[-1 0]",
+        "[0 0],[1 0],[-1 0]",
+        // sixth pin: counts 0=4 1=1 2=1 are halved to 0=2 1=1 2=1
+        "[0 0],[1 0],[2 0]",
+        "[0 0],[1 0],[2 0]",
+        "[0 0],[1 0],[2 0]",
+        // page 2 is the only page left with a count of one
+        "[0 0],[1 0],[3 0]",
+        "[0 0],[1 0],[3 0]",
+        // pages 0 and 3 both have a count of two, page 0 is older
+        "[4 0],[1 0],[3 0]"
+    };
+    const int agingRequests[] = {0,0,0,0,1,2,1,1,3,3,4};
+    const int numAgingRequests = 11;
+    BM_LFUParams aging = { .decayInterval = 6 };
+
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_LFU, &aging));
+
+    for(i = 0; i < numAgingRequests; i++)
+    {
+        pinPage(bm, h, agingRequests[i]);
+        unpinPage(bm, h);
+        ASSERT_EQUALS_POOL(agingContents[i], bm, "check pool content with aging");
+    }
+
+    ASSERT_EQUALS_INT(0, getNumWriteIO(bm), "check number of write I/Os");
+    ASSERT_EQUALS_INT(5, getNumReadIO(bm), "check number of read I/Os");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
 // test error cases
 void
 testError (void)
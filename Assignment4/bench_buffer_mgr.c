@@ -0,0 +1,998 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "buffer_mgr.h"
+#include "buffer_mgr_stat.h"
+#include "storage_mgr.h"
+#include "dberror.h"
+
+#define BENCH_FILE "bench_buffer.bin"
+
+// Page files are created sparse so large pools do not need real disk space.
+static void createBenchFile(int numPages) {
+    FILE *fp = fopen(BENCH_FILE, "wb");
+    if (fp == NULL) {
+        printf("cannot create %s\n", BENCH_FILE);
+        exit(1);
+    }
+    if (ftruncate(fileno(fp), (off_t)numPages * PAGE_SIZE) != 0) {
+        printf("cannot size %s\n", BENCH_FILE);
+        exit(1);
+    }
+    fclose(fp);
+}
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned int nextRandom(unsigned int *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+// Pin throughput on a fully resident pool: every request is a hit, so the
+// cost is dominated by the page-number -> frame lookup.
+static void benchLookup(int maxFrames) {
+    int ops = 2000000;
+    BM_BufferPool bm;
+    BM_PageHandle h;
+
+    createBenchFile(maxFrames);
+    printf("frames,pins_per_sec,ns_per_pin\n");
+    for (int frames = 16; frames <= maxFrames; frames *= 4) {
+        CHECK(initBufferPool(&bm, BENCH_FILE, frames, RS_FIFO, NULL));
+        for (int p = 0; p < frames; p++) {
+            CHECK(pinPage(&bm, &h, p));
+            CHECK(unpinPage(&bm, &h));
+        }
+
+        unsigned int seed = 12345;
+        double start = nowSeconds();
+        for (int i = 0; i < ops; i++) {
+            int p = nextRandom(&seed) % frames;
+            pinPage(&bm, &h, p);
+            unpinPage(&bm, &h);
+        }
+        double elapsed = nowSeconds() - start;
+        printf("%d,%.0f,%.1f\n", frames, ops / elapsed, elapsed * 1e9 / ops);
+        CHECK(shutdownBufferPool(&bm));
+    }
+    destroyPageFile(BENCH_FILE);
+}
+
+// Zipfian page ranks via inverse CDF lookup.
+typedef struct Zipf {
+    int n;
+    double *cdf;
+} Zipf;
+
+static void initZipf(Zipf *z, int n, double theta) {
+    double sum = 0;
+    z->n = n;
+    z->cdf = malloc(sizeof(double) * n);
+    for (int i = 0; i < n; i++) {
+        sum += 1.0 / pow(i + 1, theta);
+        z->cdf[i] = sum;
+    }
+    for (int i = 0; i < n; i++)
+        z->cdf[i] /= sum;
+}
+
+static int nextZipf(Zipf *z, unsigned int *seed) {
+    double u = (nextRandom(seed) & 0xFFFFFF) / (double)0x1000000;
+    int lo = 0, hi = z->n - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (z->cdf[mid] < u) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+typedef struct BenchStrategy {
+    char *name;
+    ReplacementStrategy strategy;
+    void *stratData;
+} BenchStrategy;
+
+static BM_LFUParams lfuAging = { .decayInterval = 10000 };
+static BM_LRUKParams lru3 = { .k = 3 };
+
+static BenchStrategy benchStrategies[] = {
+    { "FIFO", RS_FIFO, NULL },
+    { "LRU", RS_LRU, NULL },
+    { "CLOCK", RS_CLOCK, NULL },
+    { "LFU", RS_LFU, NULL },
+    { "LFU-aging", RS_LFU, &lfuAging },
+    { "LRU-2", RS_LRU_K, NULL },
+    { "LRU-3", RS_LRU_K, &lru3 },
+    { "ARC", RS_ARC, NULL },
+    { "2Q", RS_2Q, NULL },
+};
+#define NUM_BENCH_STRATEGIES (int)(sizeof(benchStrategies) / sizeof(benchStrategies[0]))
+
+static const char *policyWorkloads[] = { "zipf", "shift", "scan" };
+
+#define POLICY_FRAMES 256
+#define POLICY_PAGES (16 * POLICY_FRAMES)
+#define POLICY_OPS 400000
+
+// Hit ratio of one strategy on a Zipfian (theta 0.99) reference string.
+// "zipf" keeps the same hot set throughout; "shift" moves the hot set to
+// different pages halfway through, which punishes policies that never
+// forget old reference counts; "scan" interleaves the point lookups with
+// sequential scans over pages outside the Zipfian range, the way a table
+// scan runs next to getRecord calls.
+static double runPolicy(BenchStrategy *bs, const BM_PoolConfig *config, Zipf *z,
+                        int workload, int *sketchBytes) {
+    BM_BufferPool bm;
+    BM_PageHandle h;
+    unsigned int seed = 4242;
+    int scanPos = 0;
+
+    CHECK(initBufferPoolWithConfig(&bm, BENCH_FILE, POLICY_FRAMES, bs->strategy,
+                                   bs->stratData, config));
+    for (int i = 0; i < POLICY_OPS; i++) {
+        int p = nextZipf(z, &seed);
+        if (workload == 1 && i >= POLICY_OPS / 2) p = (p + POLICY_PAGES / 2) % POLICY_PAGES;
+        if (workload == 2 && i % 1000 >= 700) p = POLICY_PAGES + scanPos++ % POLICY_PAGES;
+        CHECK(pinPage(&bm, &h, p));
+        CHECK(unpinPage(&bm, &h));
+    }
+    double hitRatio = 1.0 - (double)getNumReadIO(&bm) / POLICY_OPS;
+    if (sketchBytes != NULL) *sketchBytes = getAdmissionSketchBytes(&bm);
+    CHECK(shutdownBufferPool(&bm));
+    return hitRatio;
+}
+
+static void benchPolicies(void) {
+    Zipf z;
+
+    initZipf(&z, POLICY_PAGES, 0.99);
+    createBenchFile(2 * POLICY_PAGES);
+    printf("workload,strategy,frames,hit_ratio\n");
+    for (int w = 0; w < 3; w++) {
+        for (int s = 0; s < NUM_BENCH_STRATEGIES; s++) {
+            BenchStrategy *bs = &benchStrategies[s];
+            printf("%s,%s,%d,%.4f\n", policyWorkloads[w], bs->name, POLICY_FRAMES,
+                   runPolicy(bs, NULL, &z, w, NULL));
+        }
+    }
+    free(z.cdf);
+    destroyPageFile(BENCH_FILE);
+}
+
+// Every strategy with and without the TinyLFU admission filter.
+static void benchAdmission(void) {
+    BM_PoolConfig admit = { .admission = true };
+    Zipf z;
+
+    initZipf(&z, POLICY_PAGES, 0.99);
+    createBenchFile(2 * POLICY_PAGES);
+    printf("workload,strategy,frames,hit_ratio,admission_hit_ratio,sketch_bytes\n");
+    for (int w = 0; w < 3; w++) {
+        for (int s = 0; s < NUM_BENCH_STRATEGIES; s++) {
+            BenchStrategy *bs = &benchStrategies[s];
+            int bytes = 0;
+            double plain = runPolicy(bs, NULL, &z, w, NULL);
+            double filtered = runPolicy(bs, &admit, &z, w, &bytes);
+            printf("%s,%s,%d,%.4f,%.4f,%d\n", policyWorkloads[w], bs->name,
+                   POLICY_FRAMES, plain, filtered, bytes);
+        }
+    }
+    free(z.cdf);
+    destroyPageFile(BENCH_FILE);
+}
+
+// Every strategy at several pool sizes under four workloads over a 4096-page
+// file, one CSV line per run with throughput, hit ratio and I/O.
+//   zipf     point lookups with Zipfian (theta 0.99) skew
+//   uniform  point lookups spread evenly over the file
+//   scan     repeated sequential passes over the whole file
+//   mixed    Zipfian lookups, every tenth one an update, interleaved with a
+//            sequential scan that takes 30% of the pins
+#define WORKLOAD_PAGES 4096
+
+static const int workloadFrames[] = { 16, 64, 256, 1024 };
+static const char *workloadNames[] = { "zipf", "uniform", "scan", "mixed" };
+
+static void runWorkload(BenchStrategy *bs, int frames, int workload, Zipf *z, int ops) {
+    BM_BufferPool bm;
+    BM_PageHandle h;
+    unsigned int seed = 4242;
+    int scanPos = 0;
+
+    CHECK(initBufferPool(&bm, BENCH_FILE, frames, bs->strategy, bs->stratData));
+    double start = nowSeconds();
+    for (int i = 0; i < ops; i++) {
+        bool update = false;
+        int p;
+        if (workload == 0) {
+            p = nextZipf(z, &seed);
+        } else if (workload == 1) {
+            p = nextRandom(&seed) % WORKLOAD_PAGES;
+        } else if (workload == 2 || i % 10 >= 7) {
+            p = scanPos++ % WORKLOAD_PAGES;
+        } else {
+            p = nextZipf(z, &seed);
+            update = i % 100 < 10;
+        }
+        CHECK(pinPage(&bm, &h, p));
+        if (update) CHECK(markDirty(&bm, &h));
+        CHECK(unpinPage(&bm, &h));
+    }
+    double elapsed = nowSeconds() - start;
+    int reads = getNumReadIO(&bm);
+    int writes = getNumWriteIO(&bm);
+    CHECK(shutdownBufferPool(&bm));
+    printf("%s,%s,%d,%d,%.0f,%.4f,%d,%d\n", workloadNames[workload], bs->name, frames, ops,
+           ops / elapsed, 1.0 - (double)reads / ops, reads, writes);
+}
+
+static void benchWorkloads(int ops) {
+    Zipf z;
+
+    initZipf(&z, WORKLOAD_PAGES, 0.99);
+    createBenchFile(WORKLOAD_PAGES);
+    printf("workload,strategy,frames,ops,ops_per_sec,hit_ratio,read_io,write_io\n");
+    for (int w = 0; w < 4; w++) {
+        for (int s = 0; s < NUM_BENCH_STRATEGIES; s++) {
+            for (int f = 0; f < 4; f++)
+                runWorkload(&benchStrategies[s], workloadFrames[f], w, &z, ops);
+        }
+    }
+    free(z.cdf);
+    destroyPageFile(BENCH_FILE);
+}
+
+static int compareLatency(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// pinPage latency percentiles on an update-heavy Zipfian workload (half
+// the pins mark the page dirty), with and without the background writer.
+// Without it, every miss that picks a dirty victim writes it first.
+static void benchWriter(void) {
+    int frames = 1024;
+    int pageSpace = 8 * frames;
+    int ops = 200000;
+    double *lat = malloc(sizeof(double) * ops);
+    BM_BufferPool bm;
+    BM_PageHandle h;
+    Zipf z;
+
+    initZipf(&z, pageSpace, 0.99);
+    createBenchFile(pageSpace);
+    printf("writer,ops_per_sec,p50_us,p99_us,p999_us,write_ios\n");
+    for (int on = 0; on < 2; on++) {
+        BM_PoolConfig config = { .concurrent = true, .numShards = 1, .backgroundWriter = on };
+        unsigned int seed = 99;
+        CHECK(initBufferPoolWithConfig(&bm, BENCH_FILE, frames, RS_CLOCK, NULL, &config));
+        double start = nowSeconds();
+        for (int i = 0; i < ops; i++) {
+            int p = nextZipf(&z, &seed);
+            double t0 = nowSeconds();
+            CHECK(pinPage(&bm, &h, p));
+            lat[i] = nowSeconds() - t0;
+            if (i % 2 == 0) {
+                h.data[0]++;
+                CHECK(markDirty(&bm, &h));
+            }
+            CHECK(unpinPage(&bm, &h));
+        }
+        double elapsed = nowSeconds() - start;
+        qsort(lat, ops, sizeof(double), compareLatency);
+        printf("%s,%.0f,%.2f,%.2f,%.2f,%d\n", on ? "on" : "off", ops / elapsed,
+               lat[ops / 2] * 1e6, lat[ops * 99 / 100] * 1e6, lat[ops * 999 / 1000] * 1e6,
+               getNumWriteIO(&bm));
+        CHECK(shutdownBufferPool(&bm));
+    }
+    free(lat);
+    free(z.cdf);
+    destroyPageFile(BENCH_FILE);
+}
+
+// A page file with real (non-sparse) contents, dropped from the OS page
+// cache so every buffer miss goes to the device.
+static void createColdFile(int numPages) {
+    char page[PAGE_SIZE];
+    FILE *fp = fopen(BENCH_FILE, "wb");
+    if (fp == NULL) {
+        printf("cannot create %s\n", BENCH_FILE);
+        exit(1);
+    }
+    for (int p = 0; p < numPages; p++) {
+        memset(page, p & 0xFF, PAGE_SIZE);
+        fwrite(page, 1, PAGE_SIZE, fp);
+    }
+    fflush(fp);
+    fsync(fileno(fp));
+    posix_fadvise(fileno(fp), 0, 0, POSIX_FADV_DONTNEED);
+    fclose(fp);
+}
+
+static void dropFileCache(void) {
+    int fd = open(BENCH_FILE, O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+static const char *prefetchModes[] = { "off", "explicit", "readahead" };
+
+// Cold sequential scan: pin, process and unpin every page of the file in
+// order, like next() walking a table. "explicit" asks for the next window
+// of pages with prefetchPages each time the scan enters a new window;
+// "readahead" leaves it to the pool's sequential detection.
+static void benchPrefetch(void) {
+    int frames = 256;
+    int numPages = 32768;
+    int window = 32;
+    BM_BufferPool bm;
+    BM_PageHandle h;
+
+    createColdFile(numPages);
+    printf("prefetch,work_passes,seconds,pages_per_sec,prefetch_hits,prefetch_wasted\n");
+    for (int work = 0; work <= 8; work += 4) {
+        for (int mode = 0; mode < 3; mode++) {
+            BM_PoolConfig config = { .readAhead = mode == 2 };
+            volatile unsigned long sum = 0;
+            dropFileCache();
+            CHECK(initBufferPoolWithConfig(&bm, BENCH_FILE, frames, RS_LRU, NULL, &config));
+            double start = nowSeconds();
+            for (int p = 0; p < numPages; p++) {
+                if (mode == 1 && p % window == 0)
+                    CHECK(prefetchPages(&bm, p + window, window));
+                CHECK(pinPage(&bm, &h, p));
+                for (int w = 0; w < work; w++)
+                    for (int i = 0; i < PAGE_SIZE; i++)
+                        sum += (unsigned char)h.data[i] * (w + 1);
+                CHECK(unpinPage(&bm, &h));
+            }
+            double elapsed = nowSeconds() - start;
+            int hits = getNumPrefetchHits(&bm);
+            int wasted = getNumPrefetchWasted(&bm);
+            CHECK(shutdownBufferPool(&bm));
+            printf("%s,%d,%.3f,%.0f,%d,%d\n", prefetchModes[mode], work, elapsed,
+                   numPages / elapsed, hits, wasted);
+        }
+    }
+    destroyPageFile(BENCH_FILE);
+}
+
+static const char *ringModes[] = { "none", "plain", "ring" };
+
+#define RING_FRAMES 16
+#define RING_LOOKUPS_PER_PAGE 4
+
+// Hit ratio of Zipfian point lookups while a table scan runs next to them:
+// every scanned page is followed by a few lookups. "none" is the lookups
+// alone, "plain" scans with pinPage and "ring" with pinPageWithRing.
+static void benchRing(void) {
+    int scanPages = 4 * POLICY_PAGES;
+    Zipf z;
+
+    initZipf(&z, POLICY_PAGES, 0.99);
+    createBenchFile(POLICY_PAGES + scanPages);
+    printf("strategy,scan,frames,lookup_hit_ratio,scan_reads\n");
+    for (int s = 0; s < NUM_BENCH_STRATEGIES; s++) {
+        BenchStrategy *bs = &benchStrategies[s];
+        for (int mode = 0; mode < 3; mode++) {
+            BM_BufferPool bm;
+            BM_PageHandle h;
+            BM_AccessRing ring;
+            unsigned int seed = 4242;
+            int lookups = 0, lookupMisses = 0;
+
+            CHECK(initBufferPool(&bm, BENCH_FILE, POLICY_FRAMES, bs->strategy, bs->stratData));
+            CHECK(initAccessRing(&bm, &ring, RING_FRAMES));
+            // warm up on the lookups alone
+            for (int i = 0; i < POLICY_FRAMES * 16; i++) {
+                CHECK(pinPage(&bm, &h, nextZipf(&z, &seed)));
+                CHECK(unpinPage(&bm, &h));
+            }
+            int reads = getNumReadIO(&bm);
+            for (int p = 0; p < scanPages; p++) {
+                if (mode == 1) CHECK(pinPage(&bm, &h, POLICY_PAGES + p));
+                if (mode == 2) CHECK(pinPageWithRing(&bm, &h, POLICY_PAGES + p, &ring));
+                if (mode != 0) CHECK(unpinPage(&bm, &h));
+                for (int l = 0; l < RING_LOOKUPS_PER_PAGE; l++) {
+                    int before = getNumReadIO(&bm);
+                    CHECK(pinPage(&bm, &h, nextZipf(&z, &seed)));
+                    CHECK(unpinPage(&bm, &h));
+                    lookups++;
+                    lookupMisses += getNumReadIO(&bm) - before;
+                }
+            }
+            int scanReads = getNumReadIO(&bm) - reads - lookupMisses;
+            CHECK(freeAccessRing(&ring));
+            CHECK(shutdownBufferPool(&bm));
+            printf("%s,%s,%d,%.4f,%d\n", bs->name, ringModes[mode], POLICY_FRAMES,
+                   1.0 - (double)lookupMisses / lookups, scanReads);
+        }
+    }
+    free(z.cdf);
+    destroyPageFile(BENCH_FILE);
+}
+
+// dTLB load misses of this thread, or -1 where perf events are not
+// available (containers, most VMs).
+static int openTLBCounter(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long long readCounter(int fd) {
+    long long value = -1;
+    if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value)) return -1;
+    return value;
+}
+
+// Transparent huge pages backing this process, from /proc/self/smaps_rollup.
+static long anonHugeKB(void) {
+    char line[256];
+    long kb = -1;
+    FILE *fp = fopen("/proc/self/smaps_rollup", "r");
+    if (fp == NULL) return -1;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) break;
+    }
+    fclose(fp);
+    return kb;
+}
+
+// Cost of a large pool's frame arena: time to create the pool, time to
+// fill every frame once, and random hits that read a byte of each page so
+// the data side of the TLB is exercised as well as the page table.
+static void benchArena(int frames) {
+    int ops = 4000000;
+    BM_BufferPool bm;
+    BM_PageHandle h;
+    unsigned int seed = 777;
+    volatile unsigned long sum = 0;
+
+    createBenchFile(frames);
+    printf("frames,init_ms,fill_ms,ns_per_hit,dtlb_misses_per_hit,anon_huge_kb\n");
+    double start = nowSeconds();
+    CHECK(initBufferPool(&bm, BENCH_FILE, frames, RS_CLOCK, NULL));
+    double init = nowSeconds() - start;
+
+    start = nowSeconds();
+    for (int p = 0; p < frames; p++) {
+        CHECK(pinPage(&bm, &h, p));
+        h.data[p % PAGE_SIZE] = 1;
+        CHECK(unpinPage(&bm, &h));
+    }
+    double fill = nowSeconds() - start;
+
+    int fd = openTLBCounter();
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    start = nowSeconds();
+    for (int i = 0; i < ops; i++) {
+        CHECK(pinPage(&bm, &h, nextRandom(&seed) % frames));
+        sum += (unsigned char)h.data[i % PAGE_SIZE];
+        CHECK(unpinPage(&bm, &h));
+    }
+    double hits = nowSeconds() - start;
+    long long misses = readCounter(fd);
+    if (fd >= 0) close(fd);
+
+    printf("%d,%.1f,%.1f,%.1f,%.3f,%ld\n", frames, init * 1e3, fill * 1e3, hits / ops * 1e9,
+           misses >= 0 ? (double)misses / ops : -1.0, anonHugeKB());
+    CHECK(shutdownBufferPool(&bm));
+    destroyPageFile(BENCH_FILE);
+}
+
+static int victimPinned[] = { 0, 900, 990, 999 }; // per mille
+
+// Cost of a miss when victim selection has to walk past pinned frames:
+// the pool is filled, a share of its frames stays pinned in runs (999 per
+// mille leaves one unpinned frame in every 1000), and every later pin is a miss on a new page. Only the scanning
+// strategies are measured; the list-based ones pop their victim directly.
+static void benchVictim(int frames) {
+    int evictions = 100000;
+    BenchStrategy scanning[] = { { "FIFO", RS_FIFO, NULL }, { "CLOCK", RS_CLOCK, NULL } };
+    BM_PageHandle *held = malloc(sizeof(BM_PageHandle) * frames);
+    BM_BufferPool bm;
+    BM_PageHandle h;
+
+    createBenchFile(frames + evictions);
+    printf("strategy,frames,pinned_per_mille,ns_per_eviction\n");
+    for (int s = 0; s < 2; s++) {
+        for (int v = 0; v < (int)(sizeof(victimPinned) / sizeof(victimPinned[0])); v++) {
+            int numHeld = 0;
+            CHECK(initBufferPool(&bm, BENCH_FILE, frames, scanning[s].strategy, NULL));
+            for (int p = 0; p < frames; p++) {
+                CHECK(pinPage(&bm, &held[numHeld], p));
+                if (p % 1000 < victimPinned[v]) numHeld++;
+                else CHECK(unpinPage(&bm, &held[numHeld]));
+            }
+            double start = nowSeconds();
+            for (int i = 0; i < evictions; i++) {
+                CHECK(pinPage(&bm, &h, frames + i));
+                CHECK(unpinPage(&bm, &h));
+            }
+            double elapsed = nowSeconds() - start;
+            for (int i = 0; i < numHeld; i++) CHECK(unpinPage(&bm, &held[i]));
+            CHECK(shutdownBufferPool(&bm));
+            printf("%s,%d,%d,%.1f\n", scanning[s].name, frames, victimPinned[v],
+                   elapsed / evictions * 1e9);
+        }
+    }
+    free(held);
+    destroyPageFile(BENCH_FILE);
+}
+
+#define RESIZE_PHASES 8
+#define RESIZE_HOT_PERCENT 80
+
+// Two tables share 2 * POLICY_FRAMES frames, one pool each. Every phase
+// one table takes RESIZE_HOT_PERCENT of the Zipfian lookups and the other
+// the rest, and the hot one changes every phase. "static" keeps an even
+// split; "rebalanced" gives the hot table three quarters of the frames
+// with resizeBufferPool at each phase change, shrinking the other first;
+// "shared" attaches both to one shared pool of all the frames and lets the
+// strategy divide them.
+static const char *resizeModes[] = { "static", "rebalanced", "shared" };
+
+static void benchResize(void) {
+    int budget = 2 * POLICY_FRAMES;
+    BM_PoolConfig config = { .maxPages = budget };
+    Zipf z;
+
+    initZipf(&z, POLICY_PAGES, 0.99);
+    createBenchFile(2 * POLICY_PAGES);
+    printf("strategy,mode,frames,hit_ratio,us_per_resize\n");
+    for (int s = 0; s < NUM_BENCH_STRATEGIES; s++) {
+        BenchStrategy *bs = &benchStrategies[s];
+        for (int mode = 0; mode < 3; mode++) {
+            BM_BufferPool bm[2];
+            BM_PageHandle h;
+            unsigned int seed = 4242;
+            int resizes = 0;
+            double resizeTime = 0;
+
+            if (mode == 2)
+                CHECK(initSharedBufferPool(budget, bs->strategy, bs->stratData, NULL));
+            for (int t = 0; t < 2; t++)
+                CHECK(mode == 2 ? attachBufferPool(&bm[t], BENCH_FILE)
+                                : initBufferPoolWithConfig(&bm[t], BENCH_FILE, budget / 2,
+                                                           bs->strategy, bs->stratData, &config));
+            for (int phase = 0; phase < RESIZE_PHASES; phase++) {
+                int hot = phase % 2;
+                if (mode == 1) {
+                    double start = nowSeconds();
+                    CHECK(resizeBufferPool(&bm[1 - hot], budget / 4));
+                    CHECK(resizeBufferPool(&bm[hot], budget - budget / 4));
+                    resizeTime += nowSeconds() - start;
+                    resizes += 2;
+                }
+                for (int i = 0; i < POLICY_OPS / RESIZE_PHASES; i++) {
+                    int t = (int)(nextRandom(&seed) % 100) < RESIZE_HOT_PERCENT ? hot : 1 - hot;
+                    CHECK(pinPage(&bm[t], &h, t * POLICY_PAGES + nextZipf(&z, &seed)));
+                    CHECK(unpinPage(&bm[t], &h));
+                }
+            }
+            // both attachments share the file's slot, and so its counters
+            int reads = mode == 2 ? getNumReadIO(&bm[0])
+                                  : getNumReadIO(&bm[0]) + getNumReadIO(&bm[1]);
+            for (int t = 0; t < 2; t++) CHECK(shutdownBufferPool(&bm[t]));
+            if (mode == 2) CHECK(shutdownSharedBufferPool());
+            printf("%s,%s,%d,%.4f,%.1f\n", bs->name, resizeModes[mode], budget,
+                   1.0 - (double)reads / POLICY_OPS,
+                   resizes > 0 ? resizeTime / resizes * 1e6 : 0.0);
+        }
+    }
+    free(z.cdf);
+    destroyPageFile(BENCH_FILE);
+}
+
+#define WARM_FRAMES 4096
+#define WARM_PAGES 32768
+#define WARM_OPS 20000
+#define WARM_DUMP "bench_buffer.warm"
+
+static const char *warmModes[] = { "cold", "warm" };
+
+// Restart after a Zipfian workload has warmed the pool, with the file
+// dropped from the OS cache. "cold" starts empty; "warm" reloads the page
+// list the previous shutdown saved. Reported are the time initBufferPool
+// takes and the time and hit ratio of the first WARM_OPS lookups after it.
+// Hot pages are scattered over the file, as rows of a table would be.
+static void benchWarm(void) {
+    BM_BufferPool bm;
+    BM_PageHandle h;
+    Zipf z;
+
+    initZipf(&z, WARM_PAGES, 0.99);
+    createColdFile(WARM_PAGES);
+    printf("mode,frames,init_seconds,first_ops,seconds,hit_ratio\n");
+    for (int mode = 0; mode < 2; mode++) {
+        BM_PoolConfig config = { .warmFile = mode == 1 ? WARM_DUMP : NULL };
+        unsigned int seed = 4242;
+
+        // the run before the restart, which leaves the page list behind
+        remove(WARM_DUMP);
+        CHECK(initBufferPoolWithConfig(&bm, BENCH_FILE, WARM_FRAMES, RS_LRU, NULL, &config));
+        for (int i = 0; i < 10 * WARM_FRAMES; i++) {
+            CHECK(pinPage(&bm, &h, (int)(nextZipf(&z, &seed) * 7919L % WARM_PAGES)));
+            CHECK(unpinPage(&bm, &h));
+        }
+        CHECK(shutdownBufferPool(&bm));
+
+        dropFileCache();
+        double start = nowSeconds();
+        CHECK(initBufferPoolWithConfig(&bm, BENCH_FILE, WARM_FRAMES, RS_LRU, NULL, &config));
+        double initTime = nowSeconds() - start;
+        int loaded = getNumReadIO(&bm);
+        start = nowSeconds();
+        for (int i = 0; i < WARM_OPS; i++) {
+            CHECK(pinPage(&bm, &h, (int)(nextZipf(&z, &seed) * 7919L % WARM_PAGES)));
+            CHECK(unpinPage(&bm, &h));
+        }
+        double elapsed = nowSeconds() - start;
+        int misses = getNumReadIO(&bm) - loaded;
+        CHECK(shutdownBufferPool(&bm));
+        printf("%s,%d,%.3f,%d,%.3f,%.4f\n", warmModes[mode], WARM_FRAMES, initTime, WARM_OPS,
+               elapsed, 1.0 - (double)misses / WARM_OPS);
+    }
+    remove(WARM_DUMP);
+    free(z.cdf);
+    destroyPageFile(BENCH_FILE);
+}
+
+#define FLUSH_FRAMES 16384
+
+static const int flushPercents[] = { 5, 25, 50, 100 };
+
+// forceFlushPool on a pool with every frame holding a page of a large
+// file and a share of them dirty, chosen at random. Reported are the
+// pages written, the write calls they took (pages minus the writes
+// saved by coalescing runs of consecutive pages) and the time, including
+// an fsync so the writes reach the disk.
+static void benchFlush(void) {
+    int numPages = 2 * FLUSH_FRAMES;
+    BM_BufferPool bm;
+    BM_PageHandle h;
+
+    createBenchFile(numPages);
+    printf("dirty_percent,frames,pages_written,write_calls,writes_saved,seconds\n");
+    for (int p = 0; p < (int)(sizeof(flushPercents) / sizeof(flushPercents[0])); p++) {
+        int percent = flushPercents[p];
+        unsigned int seed = 4242;
+        CHECK(initBufferPool(&bm, BENCH_FILE, FLUSH_FRAMES, RS_CLOCK, NULL));
+        for (int i = 0; i < FLUSH_FRAMES; i++) {
+            CHECK(pinPage(&bm, &h, (int)(nextRandom(&seed) % numPages)));
+            if ((int)(nextRandom(&seed) % 100) < percent) CHECK(markDirty(&bm, &h));
+            CHECK(unpinPage(&bm, &h));
+        }
+        int written = getNumWriteIO(&bm);
+        double start = nowSeconds();
+        CHECK(forceFlushPool(&bm));
+        int fd = open(BENCH_FILE, O_RDONLY);
+        fsync(fd);
+        close(fd);
+        double elapsed = nowSeconds() - start;
+        written = getNumWriteIO(&bm) - written;
+        int saved = getNumWritesSaved(&bm);
+        CHECK(shutdownBufferPool(&bm));
+        printf("%d,%d,%d,%d,%d,%.3f\n", percent, FLUSH_FRAMES, written, written - saved, saved,
+               elapsed);
+    }
+    destroyPageFile(BENCH_FILE);
+}
+
+#define STATS_JSON_SIZE 4096
+
+// Cost of pinLatency on the Zipfian policy workload: ns per pin with and
+// without timing every pin, followed by the JSON snapshot of the timed run.
+static void benchStats(void) {
+    static char json[STATS_JSON_SIZE];
+    Zipf z;
+
+    initZipf(&z, POLICY_PAGES, 0.99);
+    createBenchFile(POLICY_PAGES);
+    printf("pin_latency,frames,ns_per_pin,hit_ratio\n");
+    for (int timed = 0; timed < 2; timed++) {
+        BM_PoolConfig config = { .pinLatency = timed == 1 };
+        BM_BufferPool bm;
+        BM_PageHandle h;
+        BM_PoolStats st;
+        unsigned int seed = 4242;
+
+        CHECK(initBufferPoolWithConfig(&bm, BENCH_FILE, POLICY_FRAMES, RS_CLOCK, NULL, &config));
+        double start = nowSeconds();
+        for (int i = 0; i < POLICY_OPS; i++) {
+            CHECK(pinPage(&bm, &h, nextZipf(&z, &seed)));
+            CHECK(unpinPage(&bm, &h));
+        }
+        double elapsed = nowSeconds() - start;
+        CHECK(getPoolStats(&bm, &st));
+        printf("%s,%d,%.1f,%.4f\n", timed ? "on" : "off", POLICY_FRAMES, elapsed / POLICY_OPS * 1e9,
+               (double)st.hits / (st.hits + st.misses));
+        if (timed) sprintPoolStatsJSON(&bm, json, sizeof(json));
+        CHECK(shutdownBufferPool(&bm));
+    }
+    printf("%s\n", json);
+    free(z.cdf);
+    destroyPageFile(BENCH_FILE);
+}
+
+#define BATCH_PAGES 32768
+#define BATCH_FRAMES 4096
+#define BATCH_READS 20000
+
+static const char *batchPatterns[] = { "random", "clustered" };
+
+// Multi-page reads from a cold file, n pages per read, pinned one at a
+// time with pinPage or all at once with pinPages. "random" picks pages
+// anywhere in the file; "clustered" picks them from a window of 2n
+// consecutive pages, as a B+ tree split or a batch of nearby records does.
+static void benchBatch(void) {
+    BM_PageHandle handles[64];
+    PageNumber pageNums[64];
+
+    createColdFile(BATCH_PAGES);
+    printf("pattern,pages_per_read,mode,reads_per_sec,pages_read\n");
+    for (int pattern = 0; pattern < 2; pattern++) {
+        for (int n = 4; n <= 64; n *= 4) {
+            for (int batched = 0; batched < 2; batched++) {
+                BM_BufferPool bm;
+                unsigned int seed = 4242;
+
+                dropFileCache();
+                CHECK(initBufferPool(&bm, BENCH_FILE, BATCH_FRAMES, RS_CLOCK, NULL));
+                double start = nowSeconds();
+                for (int r = 0; r < BATCH_READS; r++) {
+                    int base = nextRandom(&seed) % (BATCH_PAGES - 2 * n);
+                    for (int i = 0; i < n; i++)
+                        pageNums[i] = pattern == 0 ? (int)(nextRandom(&seed) % BATCH_PAGES)
+                                                   : base + (int)(nextRandom(&seed) % (2 * n));
+                    if (batched) {
+                        CHECK(pinPages(&bm, handles, pageNums, n));
+                    } else {
+                        for (int i = 0; i < n; i++)
+                            CHECK(pinPage(&bm, &handles[i], pageNums[i]));
+                    }
+                    for (int i = 0; i < n; i++)
+                        CHECK(unpinPage(&bm, &handles[i]));
+                }
+                double elapsed = nowSeconds() - start;
+                printf("%s,%d,%s,%.0f,%d\n", batchPatterns[pattern], n,
+                       batched ? "pinPages" : "pinPage", BATCH_READS / elapsed, getNumReadIO(&bm));
+                CHECK(shutdownBufferPool(&bm));
+            }
+        }
+    }
+    destroyPageFile(BENCH_FILE);
+}
+
+#define LATCH_HOT_PAGES 8
+
+typedef struct LatchArgs {
+    BM_BufferPool *bm;
+    BM_LatchMode mode;
+    bool optimistic;           // read with startOptimisticRead instead
+    int ops;
+    unsigned int seed;
+    unsigned int sum;
+} LatchArgs;
+
+// Reads a hot page under a latch, summing part of its contents as the
+// work done while latched.
+static void *latchWorker(void *arg) {
+    LatchArgs *a = (LatchArgs *)arg;
+    BM_PageHandle h;
+    for (int i = 0; i < a->ops; i++) {
+        int p = nextRandom(&a->seed) % LATCH_HOT_PAGES;
+        if (a->optimistic) {
+            uint64_t version;
+            unsigned int sum;
+            do {
+                CHECK(startOptimisticRead(a->bm, &h, p, &version));
+                sum = 0;
+                for (int j = 0; j < 256; j++)
+                    sum += (unsigned char)h.data[j];
+            } while (!validateOptimisticRead(a->bm, &h, version));
+            a->sum += sum;
+            continue;
+        }
+        CHECK(pinPageLatched(a->bm, &h, p, a->mode));
+        for (int j = 0; j < 256; j++)
+            a->sum += (unsigned char)h.data[j];
+        CHECK(unpinPage(a->bm, &h));
+    }
+    return NULL;
+}
+
+// Throughput of threads reading the same few hot pages through
+// pinPageLatched, with shared latches and with exclusive ones, and with
+// optimistic reads that neither pin nor latch.
+static void benchLatch(int maxThreads) {
+    int opsPerThread = 200000;
+    BM_PoolConfig config = { .concurrent = true };
+    pthread_t tids[256];
+    LatchArgs args[256];
+
+    if (maxThreads > 256) maxThreads = 256;
+    createBenchFile(LATCH_HOT_PAGES);
+    printf("latch,threads,ops_per_sec\n");
+    const char *modes[] = { "optimistic", "shared", "exclusive" };
+    for (int mode = BM_LATCH_NONE; mode <= BM_LATCH_EXCLUSIVE; mode++) {
+        for (int t = 1; t <= maxThreads; t *= 2) {
+            BM_BufferPool bm;
+            BM_PageHandle h;
+            CHECK(initBufferPoolWithConfig(&bm, BENCH_FILE, 64, RS_CLOCK, NULL, &config));
+            for (int p = 0; p < LATCH_HOT_PAGES; p++) {
+                CHECK(pinPage(&bm, &h, p));
+                CHECK(unpinPage(&bm, &h));
+            }
+            double start = nowSeconds();
+            for (int i = 0; i < t; i++) {
+                args[i] = (LatchArgs){ &bm, (BM_LatchMode)mode, mode == BM_LATCH_NONE,
+                                       opsPerThread, 7919 * (i + 1), 0 };
+                pthread_create(&tids[i], NULL, latchWorker, &args[i]);
+            }
+            for (int i = 0; i < t; i++)
+                pthread_join(tids[i], NULL);
+            double elapsed = nowSeconds() - start;
+            printf("%s,%d,%.0f\n", modes[mode], t, (double)t * opsPerThread / elapsed);
+            CHECK(shutdownBufferPool(&bm));
+        }
+    }
+    destroyPageFile(BENCH_FILE);
+}
+
+typedef struct StressArgs {
+    BM_BufferPool *bm;
+    int pageSpace;
+    int ops;
+    unsigned int seed;
+} StressArgs;
+
+static void *stressWorker(void *arg) {
+    StressArgs *a = (StressArgs *)arg;
+    BM_PageHandle h;
+    for (int i = 0; i < a->ops; i++) {
+        int p = nextRandom(&a->seed) % a->pageSpace;
+        if (pinPage(a->bm, &h, p) == RC_OK)
+            unpinPage(a->bm, &h);
+    }
+    return NULL;
+}
+
+// Concurrent pin/unpin throughput for 1..maxThreads threads. "hits" keeps
+// the working set resident, "mixed" uses twice as many pages as frames so
+// about half the pins miss and evict.
+static void benchThreads(int maxThreads) {
+    int frames = 4096;
+    int opsPerThread = 500000;
+    BM_BufferPool bm;
+    BM_PoolConfig config = { .concurrent = true, .numShards = 0 };
+    pthread_t tids[256];
+    StressArgs args[256];
+
+    if (maxThreads > 256) maxThreads = 256;
+    createBenchFile(2 * frames);
+    printf("workload,shards,threads,ops_per_sec\n");
+    for (int w = 0; w < 2; w++) {
+        int pageSpace = w == 0 ? frames / 2 : 2 * frames;
+        for (int sharded = 0; sharded < 2; sharded++) {
+            config.numShards = sharded ? 64 : 1;
+            for (int t = 1; t <= maxThreads; t *= 2) {
+                CHECK(initBufferPoolWithConfig(&bm, BENCH_FILE, frames, RS_CLOCK, NULL, &config));
+                double start = nowSeconds();
+                for (int i = 0; i < t; i++) {
+                    args[i].bm = &bm;
+                    args[i].pageSpace = pageSpace;
+                    args[i].ops = opsPerThread;
+                    args[i].seed = 7919 * (i + 1);
+                    pthread_create(&tids[i], NULL, stressWorker, &args[i]);
+                }
+                for (int i = 0; i < t; i++)
+                    pthread_join(tids[i], NULL);
+                double elapsed = nowSeconds() - start;
+                printf("%s,%d,%d,%.0f\n", w == 0 ? "hits" : "mixed",
+                       config.numShards, t, (double)t * opsPerThread / elapsed);
+                CHECK(shutdownBufferPool(&bm));
+            }
+        }
+    }
+    destroyPageFile(BENCH_FILE);
+}
+
+static void usage(char *prog) {
+    printf("usage: %s lookup [maxFrames]\n", prog);
+    printf("       %s threads [maxThreads]\n", prog);
+    printf("       %s policies\n", prog);
+    printf("       %s admission\n", prog);
+    printf("       %s workloads [opsPerRun]\n", prog);
+    printf("       %s writer\n", prog);
+    printf("       %s prefetch\n", prog);
+    printf("       %s ring\n", prog);
+    printf("       %s arena [frames]\n", prog);
+    printf("       %s victim [frames]\n", prog);
+    printf("       %s resize\n", prog);
+    printf("       %s warm\n", prog);
+    printf("       %s flush\n", prog);
+    printf("       %s stats\n", prog);
+    printf("       %s latch [maxThreads]\n", prog);
+    printf("       %s batch\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (strcmp(argv[1], "lookup") == 0) {
+        benchLookup(argc > 2 ? atoi(argv[2]) : 262144);
+    } else if (strcmp(argv[1], "threads") == 0) {
+        int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        benchThreads(argc > 2 ? atoi(argv[2]) : 2 * (cpus > 0 ? cpus : 1));
+    } else if (strcmp(argv[1], "policies") == 0) {
+        benchPolicies();
+    } else if (strcmp(argv[1], "admission") == 0) {
+        benchAdmission();
+    } else if (strcmp(argv[1], "workloads") == 0) {
+        int ops = argc > 2 ? atoi(argv[2]) : 100000;
+        if (ops <= 0) {
+            usage(argv[0]);
+            return 1;
+        }
+        benchWorkloads(ops);
+    } else if (strcmp(argv[1], "writer") == 0) {
+        benchWriter();
+    } else if (strcmp(argv[1], "prefetch") == 0) {
+        benchPrefetch();
+    } else if (strcmp(argv[1], "ring") == 0) {
+        benchRing();
+    } else if (strcmp(argv[1], "arena") == 0) {
+        benchArena(argc > 2 ? atoi(argv[2]) : 262144);
+    } else if (strcmp(argv[1], "victim") == 0) {
+        benchVictim(argc > 2 ? atoi(argv[2]) : 65536);
+    } else if (strcmp(argv[1], "resize") == 0) {
+        benchResize();
+    } else if (strcmp(argv[1], "warm") == 0) {
+        benchWarm();
+    } else if (strcmp(argv[1], "flush") == 0) {
+        benchFlush();
+    } else if (strcmp(argv[1], "stats") == 0) {
+        benchStats();
+    } else if (strcmp(argv[1], "latch") == 0) {
+        int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        benchLatch(argc > 2 ? atoi(argv[2]) : 2 * (cpus > 0 ? cpus : 1));
+    } else if (strcmp(argv[1], "batch") == 0) {
+        benchBatch();
+    } else {
+        usage(argv[0]);
+        return 1;
+    }
+    return 0;
+}
@@ -11,6 +11,7 @@
 #define META_PAGE 0
 #define ROOT_PAGE 1
 #define PAGE_SIZE 4096
+#define INDEX_POOL_FRAMES 100
 
 typedef struct BTreeMeta {
     int rootPage;
@@ -102,6 +103,17 @@ RC openBtree(BTreeHandle **tree, char *idxId) {
     deserializeMeta(page, &mgmt->meta);
     mgmt->fHandle = fh;
 
+    // index pages go through the process-wide buffer pool if there is one
+    rc = getSharedBufferPool() != NULL
+             ? attachBufferPool(&mgmt->bufferPool, idxId)
+             : initBufferPool(&mgmt->bufferPool, idxId, INDEX_POOL_FRAMES, RS_LRU, NULL);
+    if (rc != RC_OK) {
+        closePageFile(&fh);
+        free(mgmt);
+        free(page);
+        return rc;
+    }
+
     BTreeHandle *newTree = (BTreeHandle *)malloc(sizeof(BTreeHandle));
     newTree->idxId = idxId;
     newTree->keyType = (DataType)(mgmt->meta.keyType);
@@ -118,6 +130,7 @@ RC closeBtree(BTreeHandle *tree) {
 
     BTreeMgmtData *mgmt = (BTreeMgmtData *)tree->mgmtData;
 
+    shutdownBufferPool(&mgmt->bufferPool);
     if (mgmt->fHandle.mgmtInfo != NULL)
         fclose((FILE *)mgmt->fHandle.mgmtInfo);
 
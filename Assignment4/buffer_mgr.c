@@ -1,307 +1,3349 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
 
 #include "buffer_mgr.h"
 #include "storage_mgr.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
-#include <limits.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/mman.h>
 #include "dberror.h"
 
-#define K_VAL 2
+#define EMPTY_SLOT -1
+#define MIN_FRAMES_PER_SHARD 8
+#define DEFAULT_DIRTY_WATERMARK 10
+#define WRITER_IDLE_MS 10
+#define MIN_READ_AHEAD 4
+#define DEFAULT_MAX_READ_AHEAD 32
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define FLUSH_MAX_RUN 64
+#define TRACE_BUFFER_BYTES (64 * 1024)
 
+static void strategyUnpinned(BM_BufferPool *const bm, BM_Shard *sh, Frame *f);
+static void stopPrefetcher(BM_MgmtData *mgmt);
 
-RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName, 
+// The process-wide shared pool, see attachBufferPool.
+static BM_BufferPool sharedPool;
+static pthread_mutex_t sharedLatch = PTHREAD_MUTEX_INITIALIZER;
+
+// Latching. In the default single-threaded mode the latches are never
+// touched; concurrent pools latch a shard around page-table and
+// replacement-state changes and serialise storage manager calls, since the
+// underlying FILE * is shared.
+static void lockShard(BM_MgmtData *mgmt, BM_Shard *sh) {
+    if (mgmt->latching) pthread_mutex_lock(&sh->latch);
+}
+
+static void unlockShard(BM_MgmtData *mgmt, BM_Shard *sh) {
+    if (mgmt->latching) pthread_mutex_unlock(&sh->latch);
+}
+
+static void lockIO(BM_MgmtData *mgmt) {
+    if (mgmt->latching) pthread_mutex_lock(&mgmt->ioLatch);
+}
+
+static void unlockIO(BM_MgmtData *mgmt) {
+    if (mgmt->latching) pthread_mutex_unlock(&mgmt->ioLatch);
+}
+
+// Fix counts are changed atomically. pinPage raises them under the shard
+// latch (so eviction, which also holds it, never races a pin), while
+// unpinPage lowers them without taking any latch. They live in one array
+// per shard so victim scans read them without touching the frames.
+static int *fixCountSlot(BM_Shard *sh, Frame *f) {
+    return &sh->fixCounts[f - sh->frames];
+}
+
+static void fixFrame(BM_Shard *sh, Frame *f) {
+    __atomic_add_fetch(fixCountSlot(sh, f), 1, __ATOMIC_ACQ_REL);
+}
+
+// Returns the fix count left after the unpin, or -1 if it already was 0.
+static int unfixFrame(BM_Shard *sh, Frame *f) {
+    int *slot = fixCountSlot(sh, f);
+    int count = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    while (count > 0) {
+        if (__atomic_compare_exchange_n(slot, &count, count - 1, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return count - 1;
+    }
+    return -1;
+}
+
+static int fixCountAt(BM_Shard *sh, int idx) {
+    return __atomic_load_n(&sh->fixCounts[idx], __ATOMIC_ACQUIRE);
+}
+
+static int fixCountOf(BM_Shard *sh, Frame *f) {
+    return fixCountAt(sh, (int)(f - sh->frames));
+}
+
+// Dirty flags change under the shard latch; the pool-wide count of dirty
+// frames is kept atomically so the background writer can watch it.
+static void setDirty(BM_MgmtData *mgmt, Frame *f) {
+    if (f->isDirty) return;
+    f->isDirty = true;
+    int dirty = __atomic_add_fetch(&mgmt->numDirty, 1, __ATOMIC_RELAXED);
+    if (mgmt->writerRunning && dirty == __atomic_load_n(&mgmt->dirtyHigh, __ATOMIC_RELAXED) + 1) {
+        pthread_mutex_lock(&mgmt->writerLatch);
+        pthread_cond_signal(&mgmt->writerWake);
+        pthread_mutex_unlock(&mgmt->writerLatch);
+    }
+}
+
+static void setClean(BM_MgmtData *mgmt, Frame *f) {
+    if (!f->isDirty) return;
+    f->isDirty = false;
+    __atomic_sub_fetch(&mgmt->numDirty, 1, __ATOMIC_RELAXED);
+}
+
+static unsigned int mixPage(PageNumber pageNum) {
+    return (unsigned int)pageNum * 2654435761u;
+}
+
+static BM_Shard *shardFor(BM_MgmtData *mgmt, PageNumber pageNum) {
+    if (mgmt->numShards == 1) return &mgmt->shards[0];
+    return &mgmt->shards[(mixPage(pageNum) >> 16) % (unsigned int)mgmt->numShards];
+}
+
+// Frame i of the pool lives in shard i % numShards at local index
+// i / numShards, so shards keep their frames when the pool is walked in
+// getFrameContents order.
+static Frame *frameAt(BM_MgmtData *mgmt, int id) {
+    return &mgmt->shards[id % mgmt->numShards].frames[id / mgmt->numShards];
+}
+
+// Page keys. A private pool keys frames by page number; the shared pool
+// puts the file's slot above the low BM_FILE_PAGE_BITS bits, so the page
+// tables, ghost lists, sketch and read-ahead work on keys unchanged.
+// NO_PAGE for a page the file cannot have, or for the shared pool itself,
+// which has no file of its own.
+static PageNumber pageKey(BM_BufferPool *const bm, PageNumber pageNum) {
+    BM_MgmtData *mgmt = (BM_MgmtData *)bm->mgmtData;
+    if (!mgmt->shared) return pageNum;
+    if (bm->fileId < 0 || pageNum < 0 || pageNum >= 1 << BM_FILE_PAGE_BITS) return NO_PAGE;
+    return (PageNumber)((unsigned int)bm->fileId << BM_FILE_PAGE_BITS) | pageNum;
+}
+
+static BM_FileMgmt *keyFile(BM_MgmtData *mgmt, PageNumber key) {
+    return &mgmt->files[mgmt->shared ? key >> BM_FILE_PAGE_BITS : 0];
+}
+
+static PageNumber keyPage(BM_MgmtData *mgmt, PageNumber key) {
+    return mgmt->shared ? key & ((1 << BM_FILE_PAGE_BITS) - 1) : key;
+}
+
+// Whether f holds a page of bm's file; the shared pool's own handle sees
+// every page.
+static bool frameOfFile(BM_BufferPool *const bm, Frame *f) {
+    BM_MgmtData *mgmt = (BM_MgmtData *)bm->mgmtData;
+    if (!mgmt->shared || bm->fileId < 0) return true;
+    return f->pageNum != NO_PAGE && keyFile(mgmt, f->pageNum) == &mgmt->files[bm->fileId];
+}
+
+// Storage manager calls for the page with key, made with the I/O latch
+// held. A file being detached is still written but no longer read.
+static RC writeKey(BM_MgmtData *mgmt, PageNumber key, SM_PageHandle data) {
+    BM_FileMgmt *file = keyFile(mgmt, key);
+    if (file->refCount == 0) return RC_FILE_HANDLE_NOT_INIT;
+    RC rc = writeBlock(keyPage(mgmt, key), &file->fh, data);
+    if (rc == RC_OK) file->numWriteIO++;
+    return rc;
+}
+
+// Write back the page of frame f, with its shard latched, and mark the
+// frame clean once the write has succeeded.
+static RC writeFrame(BM_MgmtData *mgmt, BM_Shard *sh, Frame *f) {
+    lockIO(mgmt);
+    RC rc = writeKey(mgmt, f->pageNum, f->data);
+    unlockIO(mgmt);
+    if (rc != RC_OK) return rc;
+    sh->numWriteIO++;
+    setClean(mgmt, f);
+    return RC_OK;
+}
+
+static bool keyExists(BM_MgmtData *mgmt, PageNumber key) {
+    BM_FileMgmt *file = keyFile(mgmt, key);
+    return file->refCount > 0 && !file->closing &&
+           keyPage(mgmt, key) < file->fh.totalNumPages;
+}
+
+static RC readKey(BM_MgmtData *mgmt, PageNumber key, SM_PageHandle data, bool extend) {
+    BM_FileMgmt *file = keyFile(mgmt, key);
+    PageNumber pageNum = keyPage(mgmt, key);
+    if (file->refCount == 0 || file->closing) return RC_FILE_HANDLE_NOT_INIT;
+    if (pageNum >= file->fh.totalNumPages) {
+        if (!extend) return RC_READ_NON_EXISTING_PAGE;
+        RC rc = ensureCapacity(pageNum + 1, &file->fh);
+        if (rc != RC_OK) return rc;
+    }
+    RC rc = readBlock(pageNum, &file->fh, data);
+    if (rc == RC_OK) file->numReadIO++;
+    return rc;
+}
+
+// Frames change pages under the shard latch, but unpinPage reads the
+// generation and page number of a handle's frame without it.
+static void nextGeneration(Frame *f) {
+    __atomic_add_fetch(&f->generation, 1, __ATOMIC_RELEASE);
+}
+
+// Release, so an optimistic reader that finds the page also sees the latch
+// word its loader set beforehand.
+static void setFramePage(Frame *f, PageNumber pageNum) {
+    __atomic_store_n(&f->pageNum, pageNum, __ATOMIC_RELEASE);
+}
+
+// Hand a's page buffer to b and b's to a, for a page moving between frames.
+// Optimistic readers load data without the shard latch.
+static void swapFrameData(Frame *a, Frame *b) {
+    char *data = a->data;
+    __atomic_store_n(&a->data, b->data, __ATOMIC_RELAXED);
+    __atomic_store_n(&b->data, data, __ATOMIC_RELAXED);
+}
+
+// Page indexes: open addressing with linear probing, keyed by page number.
+// Items are array elements whose first field is their PageNumber, so the
+// same code serves the shard page tables and the ghost tables. Slots are
+// stored atomically because optimistic reads probe page tables unlatched.
+#define ITEM_PAGE(items, stride, i) \
+    (*(const PageNumber *)((const char *)(items) + (size_t)(i) * (stride)))
+
+static int hashPage(PageNumber pageNum, int mask) {
+    unsigned int h = mixPage(pageNum);
+    return (int)((h ^ (h >> 16)) & (unsigned int)mask);
+}
+
+// Sized to at least twice the number of items so probe chains stay short.
+static RC indexInit(PageIndex *ix, int numItems) {
+    int size = 1;
+    while (size < 2 * numItems) size <<= 1;
+    ix->slots = malloc(sizeof(int) * size);
+    if (ix->slots == NULL) return RC_NOMEM;
+    for (int i = 0; i < size; i++) ix->slots[i] = EMPTY_SLOT;
+    ix->mask = size - 1;
+    return RC_OK;
+}
+
+static int indexLookup(PageIndex *ix, const void *items, size_t stride, PageNumber pageNum) {
+    int slot = hashPage(pageNum, ix->mask);
+    while (ix->slots[slot] != EMPTY_SLOT) {
+        int idx = ix->slots[slot];
+        if (ITEM_PAGE(items, stride, idx) == pageNum) return idx;
+        slot = (slot + 1) & ix->mask;
+    }
+    return EMPTY_SLOT;
+}
+
+static void indexInsert(PageIndex *ix, const void *items, size_t stride, int item) {
+    int slot = hashPage(ITEM_PAGE(items, stride, item), ix->mask);
+    while (ix->slots[slot] != EMPTY_SLOT)
+        slot = (slot + 1) & ix->mask;
+    __atomic_store_n(&ix->slots[slot], item, __ATOMIC_RELAXED);
+}
+
+// Backward-shift deletion keeps probe chains intact without tombstones.
+static void indexRemove(PageIndex *ix, const void *items, size_t stride, PageNumber pageNum) {
+    int mask = ix->mask;
+    int slot = hashPage(pageNum, mask);
+    while (ix->slots[slot] != EMPTY_SLOT) {
+        if (ITEM_PAGE(items, stride, ix->slots[slot]) == pageNum) break;
+        slot = (slot + 1) & mask;
+    }
+    if (ix->slots[slot] == EMPTY_SLOT) return;
+
+    int hole = slot;
+    int next = (hole + 1) & mask;
+    while (ix->slots[next] != EMPTY_SLOT) {
+        int home = hashPage(ITEM_PAGE(items, stride, ix->slots[next]), mask);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            __atomic_store_n(&ix->slots[hole], ix->slots[next], __ATOMIC_RELAXED);
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    __atomic_store_n(&ix->slots[hole], EMPTY_SLOT, __ATOMIC_RELAXED);
+}
+
+static int lookupFrame(BM_Shard *sh, PageNumber pageNum) {
+    return indexLookup(&sh->pageTable, sh->frames, sizeof(Frame), pageNum);
+}
+
+// lookupFrame without the shard latch: the table may change underneath, so
+// the probe is bounded and the answer is only a hint to be validated.
+static int lookupFrameUnlatched(BM_Shard *sh, PageNumber pageNum) {
+    PageIndex *ix = &sh->pageTable;
+    int slot = hashPage(pageNum, ix->mask);
+    for (int n = 0; n <= ix->mask; n++) {
+        int idx = __atomic_load_n(&ix->slots[slot], __ATOMIC_RELAXED);
+        if (idx == EMPTY_SLOT) break;
+        if (idx < sh->capacity &&
+            __atomic_load_n(&sh->frames[idx].pageNum, __ATOMIC_ACQUIRE) == pageNum)
+            return idx;
+        slot = (slot + 1) & ix->mask;
+    }
+    return EMPTY_SLOT;
+}
+
+// Every page in a page table counts towards its file's resident pages, so
+// getNumResidentPages need not look at frames other threads may be changing.
+static void insertPageEntry(BM_MgmtData *mgmt, BM_Shard *sh, int frameIdx) {
+    indexInsert(&sh->pageTable, sh->frames, sizeof(Frame), frameIdx);
+    __atomic_add_fetch(&keyFile(mgmt, sh->frames[frameIdx].pageNum)->numResident, 1,
+                       __ATOMIC_RELAXED);
+}
+
+static void removePageEntry(BM_MgmtData *mgmt, BM_Shard *sh, PageNumber pageNum) {
+    indexRemove(&sh->pageTable, sh->frames, sizeof(Frame), pageNum);
+    __atomic_sub_fetch(&keyFile(mgmt, pageNum)->numResident, 1, __ATOMIC_RELAXED);
+}
+
+// Ghost tables: a fixed pool of entries for non-resident pages, indexed by
+// page number and linked on up to two recency lists (head = newest).
+static RC ghostInit(GhostTable *g, int capacity, int historyLen) {
+    g->capacity = capacity;
+    g->limit = capacity;
+    g->entries = malloc(sizeof(GhostEntry) * capacity);
+    g->historyStore = historyLen > 0 ? calloc((size_t)capacity * historyLen, sizeof(uint64_t)) : NULL;
+    if (g->entries == NULL || (historyLen > 0 && g->historyStore == NULL)) return RC_NOMEM;
+    for (int i = 0; i < capacity; i++) {
+        g->entries[i].pageNum = NO_PAGE;
+        g->entries[i].next = i + 1 < capacity ? i + 1 : EMPTY_SLOT;
+        g->entries[i].history = historyLen > 0 ? &g->historyStore[(size_t)i * historyLen] : NULL;
+    }
+    g->freeEntry = capacity > 0 ? 0 : EMPTY_SLOT;
+    for (int l = 0; l < 2; l++) {
+        g->head[l] = EMPTY_SLOT;
+        g->tail[l] = EMPTY_SLOT;
+        g->size[l] = 0;
+    }
+    return indexInit(&g->index, capacity);
+}
+
+static void ghostFree(GhostTable *g) {
+    free(g->entries);
+    free(g->historyStore);
+    free(g->index.slots);
+}
+
+static int ghostFind(GhostTable *g, PageNumber pageNum) {
+    return indexLookup(&g->index, g->entries, sizeof(GhostEntry), pageNum);
+}
+
+static void ghostRemove(GhostTable *g, int idx) {
+    GhostEntry *e = &g->entries[idx];
+    indexRemove(&g->index, g->entries, sizeof(GhostEntry), e->pageNum);
+    if (e->prev != EMPTY_SLOT) g->entries[e->prev].next = e->next;
+    else g->head[e->list] = e->next;
+    if (e->next != EMPTY_SLOT) g->entries[e->next].prev = e->prev;
+    else g->tail[e->list] = e->prev;
+    g->size[e->list]--;
+
+    e->pageNum = NO_PAGE;
+    e->next = g->freeEntry;
+    g->freeEntry = idx;
+}
+
+// Add pageNum at the head of list; when the table is full the oldest
+// entry of that list makes room.
+static int ghostAdd(GhostTable *g, int list, PageNumber pageNum) {
+    if (g->freeEntry == EMPTY_SLOT || g->size[0] + g->size[1] >= g->limit) {
+        if (g->tail[list] == EMPTY_SLOT) return EMPTY_SLOT;
+        ghostRemove(g, g->tail[list]);
+    }
+    int idx = g->freeEntry;
+    GhostEntry *e = &g->entries[idx];
+    g->freeEntry = e->next;
+
+    e->pageNum = pageNum;
+    e->list = list;
+    e->prev = EMPTY_SLOT;
+    e->next = g->head[list];
+    if (g->head[list] != EMPTY_SLOT) g->entries[g->head[list]].prev = idx;
+    else g->tail[list] = idx;
+    g->head[list] = idx;
+    g->size[list]++;
+    indexInsert(&g->index, g->entries, sizeof(GhostEntry), idx);
+    return idx;
+}
+
+// Keep at most limit entries (up to the capacity), forgetting the oldest
+// of list 0 first.
+static void ghostSetLimit(GhostTable *g, int limit) {
+    g->limit = limit < g->capacity ? limit : g->capacity;
+    while (g->size[0] + g->size[1] > g->limit)
+        ghostRemove(g, g->tail[0] != EMPTY_SLOT ? g->tail[0] : g->tail[1]);
+}
+
+// Intrusive frame lists (head = most recent). A frame is on at most one
+// list at a time and remembers which.
+static void listUnlink(BM_Shard *sh, Frame *f) {
+    FrameList *l = f->list;
+    if (l == NULL) return;
+    if (f->listPrev != EMPTY_SLOT) sh->frames[f->listPrev].listNext = f->listNext;
+    else l->head = f->listNext;
+    if (f->listNext != EMPTY_SLOT) sh->frames[f->listNext].listPrev = f->listPrev;
+    else l->tail = f->listPrev;
+    l->size--;
+    f->list = NULL;
+}
+
+static void listPushFront(BM_Shard *sh, FrameList *l, Frame *f) {
+    int idx = (int)(f - sh->frames);
+    f->listPrev = EMPTY_SLOT;
+    f->listNext = l->head;
+    if (l->head != EMPTY_SLOT) sh->frames[l->head].listPrev = idx;
+    else l->tail = idx;
+    l->head = idx;
+    l->size++;
+    f->list = l;
+}
+
+static void listPushBack(BM_Shard *sh, FrameList *l, Frame *f) {
+    int idx = (int)(f - sh->frames);
+    f->listNext = EMPTY_SLOT;
+    f->listPrev = l->tail;
+    if (l->tail != EMPTY_SLOT) sh->frames[l->tail].listNext = idx;
+    else l->head = idx;
+    l->tail = idx;
+    l->size++;
+    f->list = l;
+}
+
+static void listInit(FrameList *l) {
+    l->head = EMPTY_SLOT;
+    l->tail = EMPTY_SLOT;
+    l->size = 0;
+}
+
+// Lists that also hold pinned frames (ARC, 2Q) take the oldest unpinned one.
+static Frame *leastRecentUnpinned(BM_Shard *sh, FrameList *l) {
+    for (int i = l->tail; i != EMPTY_SLOT; i = sh->frames[i].listPrev) {
+        if (fixCountAt(sh, i) == 0) return &sh->frames[i];
+    }
+    return NULL;
+}
+
+// LFU frequency buckets (constant-time LFU). Every frame sits in the
+// bucket for its reference count; empty frames are in bucket 0. A hit moves
+// the frame to the next bucket, creating it if needed, and the victim is
+// the least recently used unpinned frame of the lowest bucket.
+static int lfuNewBucket(BM_Shard *sh, int freq, int after) {
+    int b = sh->lfuFreeBucket;
+    LFUBucket *bucket = &sh->lfuBuckets[b];
+    sh->lfuFreeBucket = bucket->next;
+
+    bucket->freq = freq;
+    bucket->head = EMPTY_SLOT;
+    bucket->tail = EMPTY_SLOT;
+    bucket->prev = after;
+    bucket->next = after == EMPTY_SLOT ? sh->lfuFirst : sh->lfuBuckets[after].next;
+    if (bucket->next != EMPTY_SLOT) sh->lfuBuckets[bucket->next].prev = b;
+    if (after == EMPTY_SLOT) sh->lfuFirst = b;
+    else sh->lfuBuckets[after].next = b;
+    return b;
+}
+
+static void lfuFreeIfEmpty(BM_Shard *sh, int b) {
+    LFUBucket *bucket = &sh->lfuBuckets[b];
+    if (bucket->head != EMPTY_SLOT) return;
+    if (bucket->prev != EMPTY_SLOT) sh->lfuBuckets[bucket->prev].next = bucket->next;
+    else sh->lfuFirst = bucket->next;
+    if (bucket->next != EMPTY_SLOT) sh->lfuBuckets[bucket->next].prev = bucket->prev;
+    bucket->next = sh->lfuFreeBucket;
+    sh->lfuFreeBucket = b;
+}
+
+static void lfuInsert(BM_Shard *sh, int b, Frame *f, bool atHead) {
+    LFUBucket *bucket = &sh->lfuBuckets[b];
+    int idx = (int)(f - sh->frames);
+    if (atHead) {
+        f->listPrev = EMPTY_SLOT;
+        f->listNext = bucket->head;
+        if (bucket->head != EMPTY_SLOT) sh->frames[bucket->head].listPrev = idx;
+        else bucket->tail = idx;
+        bucket->head = idx;
+    } else {
+        f->listNext = EMPTY_SLOT;
+        f->listPrev = bucket->tail;
+        if (bucket->tail != EMPTY_SLOT) sh->frames[bucket->tail].listNext = idx;
+        else bucket->head = idx;
+        bucket->tail = idx;
+    }
+    f->lfuBucket = b;
+}
+
+static void lfuRemove(BM_Shard *sh, Frame *f) {
+    LFUBucket *bucket = &sh->lfuBuckets[f->lfuBucket];
+    if (f->listPrev != EMPTY_SLOT) sh->frames[f->listPrev].listNext = f->listNext;
+    else bucket->head = f->listNext;
+    if (f->listNext != EMPTY_SLOT) sh->frames[f->listNext].listPrev = f->listPrev;
+    else bucket->tail = f->listPrev;
+}
+
+// Move f into the bucket for freq, which must sort at or after 'from'.
+static void lfuMove(BM_Shard *sh, Frame *f, int freq, int from, bool atHead) {
+    int old = f->lfuBucket;
+    int target = from;
+    int prev = EMPTY_SLOT;
+    if (target == EMPTY_SLOT) target = sh->lfuFirst;
+    else prev = sh->lfuBuckets[target].prev;
+    while (target != EMPTY_SLOT && sh->lfuBuckets[target].freq < freq) {
+        prev = target;
+        target = sh->lfuBuckets[target].next;
+    }
+    if (target == EMPTY_SLOT || sh->lfuBuckets[target].freq != freq)
+        target = lfuNewBucket(sh, freq, prev);
+
+    lfuRemove(sh, f);
+    lfuInsert(sh, target, f, atHead);
+    lfuFreeIfEmpty(sh, old);
+}
+
+// Aging: halve every reference count so pages that were hot long ago can
+// be evicted. Halving keeps the bucket order, so buckets that collapse onto
+// the same count are spliced together, the hotter one at the head.
+static void lfuDecay(BM_Shard *sh) {
+    int out = EMPTY_SLOT;
+    int b = sh->lfuFirst;
+    while (b != EMPTY_SLOT) {
+        LFUBucket *bucket = &sh->lfuBuckets[b];
+        int next = bucket->next;
+        int freq = bucket->freq == 0 ? 0 : (bucket->freq / 2 > 0 ? bucket->freq / 2 : 1);
+
+        if (out != EMPTY_SLOT && sh->lfuBuckets[out].freq == freq) {
+            LFUBucket *into = &sh->lfuBuckets[out];
+            for (int i = bucket->head; i != EMPTY_SLOT; i = sh->frames[i].listNext)
+                sh->frames[i].lfuBucket = out;
+            sh->frames[bucket->tail].listNext = into->head;
+            sh->frames[into->head].listPrev = bucket->tail;
+            into->head = bucket->head;
+            bucket->head = EMPTY_SLOT;
+            lfuFreeIfEmpty(sh, b);
+        } else {
+            bucket->freq = freq;
+            out = b;
+        }
+        b = next;
+    }
+    sh->lfuSinceDecay = 0;
+}
+
+static void lfuCounted(BM_Shard *sh) {
+    if (sh->lfuDecayInterval > 0 && ++sh->lfuSinceDecay >= sh->lfuDecayInterval)
+        lfuDecay(sh);
+}
+
+// RS_LRU_K (O'Neil et al.): a page's priority is its K-th most recent
+// uncorrelated reference, HIST(p, K); pages with fewer than K references
+// have an infinite backward distance (stored as 0) and go first, oldest
+// last reference first. Unpinned frames sit in a binary heap on that key
+// once their correlated period is over; until then they wait on
+// lrukRecent, ordered by last reference, and are not eviction candidates.
+static bool lrukBefore(BM_Shard *sh, Frame *a, Frame *b) {
+    uint64_t ka = a->history[sh->lrukK - 1];
+    uint64_t kb = b->history[sh->lrukK - 1];
+    if (ka != kb) return ka < kb;
+    if (a->lastUsed != b->lastUsed) return a->lastUsed < b->lastUsed;
+    return a < b;
+}
+
+static void lrukPlace(BM_Shard *sh, int pos, int idx) {
+    sh->lrukHeap[pos] = idx;
+    sh->frames[idx].heapPos = pos;
+}
+
+static void lrukSiftUp(BM_Shard *sh, int pos) {
+    int idx = sh->lrukHeap[pos];
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (!lrukBefore(sh, &sh->frames[idx], &sh->frames[sh->lrukHeap[parent]])) break;
+        lrukPlace(sh, pos, sh->lrukHeap[parent]);
+        pos = parent;
+    }
+    lrukPlace(sh, pos, idx);
+}
+
+static void lrukSiftDown(BM_Shard *sh, int pos) {
+    int idx = sh->lrukHeap[pos];
+    for (;;) {
+        int child = 2 * pos + 1;
+        if (child >= sh->lrukHeapSize) break;
+        if (child + 1 < sh->lrukHeapSize &&
+            lrukBefore(sh, &sh->frames[sh->lrukHeap[child + 1]], &sh->frames[sh->lrukHeap[child]]))
+            child++;
+        if (!lrukBefore(sh, &sh->frames[sh->lrukHeap[child]], &sh->frames[idx])) break;
+        lrukPlace(sh, pos, sh->lrukHeap[child]);
+        pos = child;
+    }
+    lrukPlace(sh, pos, idx);
+}
+
+static void lrukHeapPush(BM_Shard *sh, Frame *f) {
+    int pos = sh->lrukHeapSize++;
+    lrukPlace(sh, pos, (int)(f - sh->frames));
+    lrukSiftUp(sh, pos);
+}
+
+static bool lrukCorrelated(BM_Shard *sh, Frame *f) {
+    return f->pageNum != NO_PAGE &&
+           sh->timestamp + 1 - f->lastUsed <= (uint64_t)sh->lrukCorrelatedPeriod;
+}
+
+// An unpinned frame becomes a candidate again. Frames are usually unpinned
+// in the order they were referenced, so the walk to f's place in lrukRecent
+// rarely takes a step.
+static void lrukPush(BM_Shard *sh, Frame *f) {
+    if (f->heapPos >= 0 || f->list == &sh->lrukRecent) return;
+    if (!lrukCorrelated(sh, f)) {
+        lrukHeapPush(sh, f);
+        return;
+    }
+    int next = sh->lrukRecent.head;
+    while (next != EMPTY_SLOT && sh->frames[next].lastUsed > f->lastUsed)
+        next = sh->frames[next].listNext;
+    if (next == EMPTY_SLOT) {
+        listPushBack(sh, &sh->lrukRecent, f);
+        return;
+    }
+    Frame *after = &sh->frames[next];
+    if (after->listPrev == EMPTY_SLOT) {
+        listPushFront(sh, &sh->lrukRecent, f);
+        return;
+    }
+    int idx = (int)(f - sh->frames);
+    f->listPrev = after->listPrev;
+    f->listNext = next;
+    sh->frames[after->listPrev].listNext = idx;
+    after->listPrev = idx;
+    sh->lrukRecent.size++;
+    f->list = &sh->lrukRecent;
+}
+
+static void lrukRemove(BM_Shard *sh, Frame *f) {
+    if (f->list == &sh->lrukRecent) {
+        listUnlink(sh, f);
+        return;
+    }
+    int pos = f->heapPos;
+    if (pos < 0) return;
+    f->heapPos = -1;
+    int last = sh->lrukHeap[--sh->lrukHeapSize];
+    if (pos == sh->lrukHeapSize) return;
+    lrukPlace(sh, pos, last);
+    lrukSiftUp(sh, pos);
+    lrukSiftDown(sh, sh->frames[last].heapPos);
+}
+
+// Record a reference at time t to a resident page. References within the
+// correlated period of the last one only move LAST; an uncorrelated one
+// shifts the history, discounting the length of the correlated burst.
+static void lrukReference(BM_Shard *sh, Frame *f, uint64_t t) {
+    if (t - f->lastUsed > (uint64_t)sh->lrukCorrelatedPeriod) {
+        uint64_t burst = f->lastUsed - f->history[0];
+        for (int i = sh->lrukK - 1; i > 0; i--)
+            f->history[i] = f->history[i - 1] != 0 ? f->history[i - 1] + burst : 0;
+        f->history[0] = t;
+    }
+}
+
+// A page was read into f at time t: pick up its retained history if it was
+// evicted recently, otherwise start a fresh one.
+static void lrukLoaded(BM_Shard *sh, Frame *f, uint64_t t) {
+    int g = ghostFind(&sh->lrukHistory, f->pageNum);
+    for (int i = sh->lrukK - 1; i > 0; i--)
+        f->history[i] = g != EMPTY_SLOT ? sh->lrukHistory.entries[g].history[i - 1] : 0;
+    f->history[0] = t;
+    if (g != EMPTY_SLOT) ghostRemove(&sh->lrukHistory, g);
+}
+
+static void lrukEvicted(BM_Shard *sh, Frame *f) {
+    int g = ghostAdd(&sh->lrukHistory, 0, f->pageNum);
+    if (g != EMPTY_SLOT)
+        memcpy(sh->lrukHistory.entries[g].history, f->history, sizeof(uint64_t) * sh->lrukK);
+}
+
+static void lrukEmptied(BM_Shard *sh, Frame *f) {
+    memset(f->history, 0, sizeof(uint64_t) * sh->lrukK);
+    f->lastUsed = 0;
+    lrukPush(sh, f);
+}
+
+// Move the frames whose correlated period has ended into the heap, then
+// take its top. If every candidate is still in its period, fall back to the
+// least recently used of them. Each frame passes through lrukRecent once per
+// reference, so an eviction costs O(log n) however long the period.
+static Frame *selectVictimLRUK(BM_Shard *sh) {
+    while (sh->lrukRecent.tail != EMPTY_SLOT) {
+        Frame *f = &sh->frames[sh->lrukRecent.tail];
+        if (lrukCorrelated(sh, f)) break;
+        listUnlink(sh, f);
+        lrukHeapPush(sh, f);
+    }
+    Frame *victim = NULL;
+    if (sh->lrukHeapSize > 0) victim = &sh->frames[sh->lrukHeap[0]];
+    else if (sh->lrukRecent.tail != EMPTY_SLOT) victim = &sh->frames[sh->lrukRecent.tail];
+    if (victim != NULL) lrukRemove(sh, victim);
+    return victim;
+}
+
+// RS_ARC (Megiddo and Modha). Resident pages are split between T1 (seen
+// once) and T2 (seen again while cached or remembered); B1 and B2 remember
+// pages recently evicted from each. A miss that hits a ghost list moves the
+// target size of T1 towards the list that would have kept the page.
+static Frame *selectVictimARC(BM_Shard *sh, PageNumber pageNum) {
+    GhostTable *g = &sh->arcGhosts;
+    int c = sh->numFrames;
+    int ghost = ghostFind(g, pageNum);
+    int inList = ghost != EMPTY_SLOT ? g->entries[ghost].list : -1;
+
+    sh->arcDropVictim = false;
+    if (inList == 0) {
+        int delta = g->size[0] >= g->size[1] ? 1 : g->size[1] / g->size[0];
+        sh->arcTarget = sh->arcTarget + delta < c ? sh->arcTarget + delta : c;
+    } else if (inList == 1) {
+        int delta = g->size[1] >= g->size[0] ? 1 : g->size[0] / g->size[1];
+        sh->arcTarget = sh->arcTarget - delta > 0 ? sh->arcTarget - delta : 0;
+    } else if (sh->arcT1.size + g->size[0] >= c) {
+        // L1 is full: forget the oldest B1 page, or if B1 is empty drop
+        // the oldest T1 page outright
+        if (g->size[0] > 0) ghostRemove(g, g->tail[0]);
+        else sh->arcDropVictim = true;
+    } else if (sh->arcT1.size + sh->arcT2.size + g->size[0] + g->size[1] >= 2 * c &&
+               g->size[1] > 0) {
+        ghostRemove(g, g->tail[1]);
+    }
+
+    if (sh->freeFrames.head != EMPTY_SLOT) {
+        sh->arcDropVictim = false;
+        return &sh->frames[sh->freeFrames.head];
+    }
+
+    Frame *victim = NULL;
+    int t1 = sh->arcT1.size;
+    if (sh->arcDropVictim ||
+        (t1 > 0 && (t1 > sh->arcTarget || (inList == 1 && t1 == sh->arcTarget))))
+        victim = leastRecentUnpinned(sh, &sh->arcT1);
+    if (victim == NULL) {
+        sh->arcDropVictim = false;
+        victim = leastRecentUnpinned(sh, &sh->arcT2);
+    }
+    if (victim == NULL) victim = leastRecentUnpinned(sh, &sh->arcT1);
+    return victim;
+}
+
+// The victim's page moves to the ghost list matching its resident list.
+static void arcEvicted(BM_Shard *sh, Frame *f) {
+    if (!sh->arcDropVictim)
+        ghostAdd(&sh->arcGhosts, f->list == &sh->arcT2 ? 1 : 0, f->pageNum);
+    listUnlink(sh, f);
+}
+
+static void arcLoaded(BM_Shard *sh, Frame *f) {
+    int ghost = ghostFind(&sh->arcGhosts, f->pageNum);
+    listUnlink(sh, f);
+    if (ghost != EMPTY_SLOT) {
+        ghostRemove(&sh->arcGhosts, ghost);
+        listPushFront(sh, &sh->arcT2, f);
+    } else {
+        listPushFront(sh, &sh->arcT1, f);
+    }
+}
+
+// RS_2Q (Johnson and Shasha, full version). A page referenced once waits in
+// the A1in FIFO; if it is referenced again while in A1in nothing happens,
+// so a scan touching each page once only ever recycles A1in frames. Pages
+// evicted from A1in are remembered in A1out, and a miss on a remembered
+// page loads it straight into the Am LRU list.
+static Frame *selectVictim2Q(BM_Shard *sh) {
+    if (sh->freeFrames.head != EMPTY_SLOT)
+        return &sh->frames[sh->freeFrames.head];
+
+    Frame *victim = NULL;
+    if (sh->q2A1in.size > sh->q2A1inMax || sh->q2Am.size == 0)
+        victim = leastRecentUnpinned(sh, &sh->q2A1in);
+    if (victim == NULL) victim = leastRecentUnpinned(sh, &sh->q2Am);
+    if (victim == NULL) victim = leastRecentUnpinned(sh, &sh->q2A1in);
+    return victim;
+}
+
+static void q2Evicted(BM_Shard *sh, Frame *f) {
+    if (f->list == &sh->q2A1in) ghostAdd(&sh->q2A1out, 0, f->pageNum);
+    listUnlink(sh, f);
+}
+
+static void q2Loaded(BM_Shard *sh, Frame *f) {
+    int ghost = ghostFind(&sh->q2A1out, f->pageNum);
+    listUnlink(sh, f);
+    if (ghost != EMPTY_SLOT) {
+        ghostRemove(&sh->q2A1out, ghost);
+        listPushFront(sh, &sh->q2Am, f);
+    } else {
+        listPushFront(sh, &sh->q2A1in, f);
+    }
+}
+
+static void q2Hit(BM_Shard *sh, Frame *f) {
+    if (f->list == &sh->q2Am) {
+        listUnlink(sh, f);
+        listPushFront(sh, &sh->q2Am, f);
+    }
+}
+
+// Kin and Kout follow the size of the shard.
+static void q2Sizes(BM_Shard *sh) {
+    sh->q2A1inMax = sh->numFrames * sh->q2InPercent / 100;
+    if (sh->q2A1inMax < 1) sh->q2A1inMax = 1;
+    int outSize = sh->numFrames * sh->q2OutPercent / 100;
+    ghostSetLimit(&sh->q2A1out, outSize > 0 ? outSize : 1);
+}
+
+static RC init2Q(BM_Shard *sh, BM_2QParams *params) {
+    sh->q2InPercent = 25;
+    sh->q2OutPercent = 50;
+    if (params != NULL) {
+        if (params->inPercent > 0) sh->q2InPercent = params->inPercent;
+        if (params->outPercent > 0) sh->q2OutPercent = params->outPercent;
+    }
+    int outCapacity = sh->capacity * sh->q2OutPercent / 100;
+    RC rc = ghostInit(&sh->q2A1out, outCapacity > 0 ? outCapacity : 1, 0);
+    if (rc != RC_OK) return rc;
+    q2Sizes(sh);
+    return RC_OK;
+}
+
+static RC initLRUK(BM_Shard *sh, BM_LRUKParams *params) {
+    int numFrames = sh->numFrames;
+    int retained = numFrames;
+    sh->lrukK = K_VAL;
+    sh->lrukCorrelatedPeriod = numFrames;
+    if (params != NULL) {
+        if (params->k > 0) sh->lrukK = params->k;
+        if (params->correlatedPeriod > 0) sh->lrukCorrelatedPeriod = params->correlatedPeriod;
+        if (params->retainedHistory > 0) retained = params->retainedHistory;
+    }
+
+    sh->lrukHeap = malloc(sizeof(int) * sh->capacity);
+    sh->lrukHistoryStore = calloc((size_t)sh->capacity * sh->lrukK, sizeof(uint64_t));
+    if (sh->lrukHeap == NULL || sh->lrukHistoryStore == NULL)
+        return RC_NOMEM;
+    for (int i = 0; i < sh->capacity; i++)
+        sh->frames[i].history = &sh->lrukHistoryStore[(size_t)i * sh->lrukK];
+    for (int i = 0; i < numFrames; i++)
+        lrukPush(sh, &sh->frames[i]);
+    return ghostInit(&sh->lrukHistory, retained, sh->lrukK);
+}
+
+// TinyLFU admission (Einziger et al.). Every pin is counted in a count-min
+// sketch. New pages enter a small LRU window outside the replacement
+// strategy; the page leaving the window is only admitted to the main pool if
+// its estimated frequency beats that of the strategy's victim.
+#define SKETCH_ROWS 4
+#define SKETCH_MAX 15
+
+static RC sketchInit(FreqSketch *sk, int numFrames) {
+    int width = 64;
+    while (width < numFrames) width <<= 1;
+    sk->counters = calloc((size_t)SKETCH_ROWS * width, 1);
+    if (sk->counters == NULL) return RC_NOMEM;
+    sk->mask = width - 1;
+    sk->additions = 0;
+    sk->sampleSize = 10 * numFrames;
+    return RC_OK;
+}
+
+static int sketchBytes(FreqSketch *sk) {
+    return sk->counters != NULL ? SKETCH_ROWS * (sk->mask + 1) : 0;
+}
+
+static uint8_t *sketchCounter(FreqSketch *sk, unsigned int h, int row) {
+    unsigned int step = (h >> 17) | 1;
+    return &sk->counters[row * (sk->mask + 1) + ((h + row * step) & (unsigned int)sk->mask)];
+}
+
+static unsigned int sketchHash(PageNumber pageNum) {
+    unsigned int h = mixPage(pageNum);
+    return h ^ (h >> 15);
+}
+
+static int sketchEstimate(FreqSketch *sk, PageNumber pageNum) {
+    unsigned int h = sketchHash(pageNum);
+    int est = SKETCH_MAX;
+    for (int r = 0; r < SKETCH_ROWS; r++) {
+        int c = *sketchCounter(sk, h, r);
+        if (c < est) est = c;
+    }
+    return est;
+}
+
+static void sketchAdd(FreqSketch *sk, PageNumber pageNum) {
+    unsigned int h = sketchHash(pageNum);
+    for (int r = 0; r < SKETCH_ROWS; r++) {
+        uint8_t *c = sketchCounter(sk, h, r);
+        if (*c < SKETCH_MAX) (*c)++;
+    }
+    if (++sk->additions >= sk->sampleSize) {
+        for (int i = 0; i < SKETCH_ROWS * (sk->mask + 1); i++)
+            sk->counters[i] >>= 1;
+        sk->additions /= 2;
+    }
+}
+
+static bool inWindow(BM_Shard *sh, Frame *f) {
+    return f - sh->frames >= sh->numFrames;
+}
+
+// Resolve the frame a handle refers to. Handles filled in by pinPage carry
+// the frame index and its generation, so the common pin -> markDirty ->
+// unpin sequence never touches the page table. A resize may move a pinned
+// page to another frame, hence the atomic loads.
+static Frame *handleFrame(BM_MgmtData *mgmt, BM_PageHandle *page, PageNumber key) {
+    int idx = page->frame;
+    if (idx >= 0 && idx < mgmt->maxPages) {
+        Frame *f = frameAt(mgmt, idx);
+        if (__atomic_load_n(&f->generation, __ATOMIC_ACQUIRE) == page->frameGen &&
+            __atomic_load_n(&f->pageNum, __ATOMIC_RELAXED) == key)
+            return f;
+    }
+    return NULL;
+}
+
+// Stale or hand-made handles fall back to a lookup by page number; the
+// caller holds the latch of the page's shard.
+static Frame *resolveFrame(BM_MgmtData *mgmt, BM_Shard *sh, BM_PageHandle *page,
+                           PageNumber key) {
+    Frame *f = handleFrame(mgmt, page, key);
+    if (f != NULL) return f;
+    int idx = lookupFrame(sh, key);
+    if (idx == EMPTY_SLOT) return NULL;
+    return &sh->frames[idx];
+}
+
+static void fillHandle(BM_MgmtData *mgmt, BM_PageHandle *page, Frame *frame) {
+    page->pageNum = keyPage(mgmt, frame->pageNum);
+    page->data = frame->data;
+    page->frame = frame->id;
+    page->frameGen = frame->generation;
+    page->latch = BM_LATCH_NONE;
+}
+
+static int chooseNumShards(const BM_PoolConfig *config, int numPages) {
+    if (config == NULL || !config->concurrent) return 1;
+    int shards = config->numShards;
+    if (shards <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        shards = cpus > 0 ? (int)cpus : 1;
+    }
+    if (shards > numPages / MIN_FRAMES_PER_SHARD)
+        shards = numPages / MIN_FRAMES_PER_SHARD;
+    return shards < 1 ? 1 : shards;
+}
+
+// Frame data lives in one anonymous mapping rather than a malloc per frame,
+// sized for maxPages frames; only the pages of frames in use get touched.
+// Pools of at least a huge page are aligned to one and advised to use
+// transparent huge pages, so a large pool is covered by a few TLB entries.
+// The mapping is zero-filled on first touch, so init does not fault in the
+// whole pool up front.
+static RC allocArena(BM_MgmtData *mgmt) {
+    size_t size = (size_t)mgmt->maxPages * PAGE_SIZE;
+    size_t align = size >= HUGE_PAGE_SIZE ? HUGE_PAGE_SIZE : (size_t)sysconf(_SC_PAGESIZE);
+    size_t mapped = size + align;
+    char *base = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) return RC_NOMEM;
+
+    // trim the mapping to an aligned range of exactly size bytes
+    char *start = (char *)(((uintptr_t)base + align - 1) & ~(uintptr_t)(align - 1));
+    if (start > base) munmap(base, start - base);
+    size_t tail = mapped - (start - base) - size;
+    if (tail > 0) munmap(start + size, tail);
+#ifdef MADV_HUGEPAGE
+    if (size >= HUGE_PAGE_SIZE) madvise(start, size, MADV_HUGEPAGE);
+#endif
+    mgmt->arena = start;
+    mgmt->arenaSize = size;
+    mgmt->pageLatches = calloc(mgmt->maxPages, sizeof(uint64_t));
+    if (mgmt->pageLatches == NULL) return RC_NOMEM;
+    return RC_OK;
+}
+
+// A shard starts with totalFrames frames in use and room for capacity.
+static RC initShard(BM_Shard *sh, int shardIdx, int numShards, int totalFrames,
+                    int capacity, char *arena, ReplacementStrategy strategy,
+                    void *stratData, const BM_PoolConfig *config) {
+    sh->numWindow = 0;
+    if (config != NULL && config->admission && totalFrames > 1) {
+        int percent = config->windowPercent > 0 ? config->windowPercent : 1;
+        sh->numWindow = totalFrames * percent / 100;
+        if (sh->numWindow < 1) sh->numWindow = 1;
+        if (sh->numWindow > totalFrames - 1) sh->numWindow = totalFrames - 1;
+    }
+    int numFrames = totalFrames - sh->numWindow;
+    sh->numFrames = numFrames;
+    sh->capacity = capacity;
+    sh->frames = malloc(sizeof(Frame) * capacity);
+    sh->fixCounts = calloc(capacity, sizeof(int));
+    sh->refBits = calloc((capacity + 63) / 64, sizeof(uint64_t));
+    if (sh->frames == NULL || sh->fixCounts == NULL || sh->refBits == NULL) return RC_NOMEM;
+
+    for (int i = 0; i < capacity; i++) {
+        Frame *f = &sh->frames[i];
+        f->pageNum = NO_PAGE;
+        f->isDirty = false;
+        f->lastUsed = 0;
+        f->list = NULL;
+        f->history = NULL;
+        f->heapPos = -1;
+        f->loading = false;
+        f->prefetched = false;
+        f->generation = 0;
+        f->id = shardIdx + i * numShards;
+        f->data = arena + (size_t)f->id * PAGE_SIZE;
+    }
+
+    RC rc = indexInit(&sh->pageTable, capacity);
+    if (rc != RC_OK) return rc;
+
+    listInit(&sh->window);
+    memset(&sh->sketch, 0, sizeof(FreqSketch));
+    sh->numAdmissionRejects = 0;
+    sh->writerCursor = 0;
+    sh->numPrefetched = 0;
+    sh->numPrefetchHits = 0;
+    sh->numPrefetchWasted = 0;
+    if (sh->numWindow > 0) {
+        for (int i = numFrames; i < totalFrames; i++)
+            listPushFront(sh, &sh->window, &sh->frames[i]);
+        rc = sketchInit(&sh->sketch, totalFrames);
+        if (rc != RC_OK) return rc;
+    }
+
+    listInit(&sh->lru);
+    if (strategy == RS_LRU) {
+        for (int i = 0; i < numFrames; i++)
+            listPushFront(sh, &sh->lru, &sh->frames[i]);
+    }
+
+    listInit(&sh->arcT1);
+    listInit(&sh->arcT2);
+    sh->arcTarget = 0;
+    sh->arcDropVictim = false;
+    memset(&sh->arcGhosts, 0, sizeof(GhostTable));
+    if (strategy == RS_ARC) {
+        // B1 + B2 never exceed c, plus the entry of the page being loaded
+        rc = ghostInit(&sh->arcGhosts, capacity + 1, 0);
+        if (rc != RC_OK) return rc;
+        ghostSetLimit(&sh->arcGhosts, numFrames + 1);
+    }
+
+    listInit(&sh->q2A1in);
+    listInit(&sh->q2Am);
+    sh->q2A1inMax = 0;
+    memset(&sh->q2A1out, 0, sizeof(GhostTable));
+    if (strategy == RS_2Q) {
+        rc = init2Q(sh, (BM_2QParams *)stratData);
+        if (rc != RC_OK) return rc;
+    }
+
+    listInit(&sh->freeFrames);
+    if (strategy == RS_ARC || strategy == RS_2Q) {
+        for (int i = 0; i < numFrames; i++)
+            listPushBack(sh, &sh->freeFrames, &sh->frames[i]);
+    }
+
+    sh->lfuBuckets = NULL;
+    sh->lfuFirst = EMPTY_SLOT;
+    sh->lfuFreeBucket = EMPTY_SLOT;
+    sh->lfuSinceDecay = 0;
+    sh->lfuDecayInterval = 0;
+    if (strategy == RS_LFU) {
+        // one bucket per distinct count, plus one while a frame moves
+        sh->lfuBuckets = malloc(sizeof(LFUBucket) * (capacity + 2));
+        if (sh->lfuBuckets == NULL) return RC_NOMEM;
+        for (int b = 0; b < capacity + 2; b++)
+            sh->lfuBuckets[b].next = b + 1 < capacity + 2 ? b + 1 : EMPTY_SLOT;
+        sh->lfuFreeBucket = 0;
+        int zero = lfuNewBucket(sh, 0, EMPTY_SLOT);
+        for (int i = 0; i < numFrames; i++)
+            lfuInsert(sh, zero, &sh->frames[i], true);
+        if (stratData != NULL)
+            sh->lfuDecayInterval = ((BM_LFUParams *)stratData)->decayInterval;
+    }
+
+    sh->lrukHeap = NULL;
+    sh->lrukHeapSize = 0;
+    listInit(&sh->lrukRecent);
+    sh->lrukHistoryStore = NULL;
+    memset(&sh->lrukHistory, 0, sizeof(GhostTable));
+    if (strategy == RS_LRU_K) {
+        rc = initLRUK(sh, (BM_LRUKParams *)stratData);
+        if (rc != RC_OK) return rc;
+    }
+
+    sh->clockHand = 0;
+    sh->fifoPtr = 0;
+    sh->timestamp = 0;
+    sh->numReadIO = 0;
+    sh->numWriteIO = 0;
+    sh->numWriteErrors = 0;
+    sh->numHits = 0;
+    sh->numMisses = 0;
+    memset(sh->numEvictions, 0, sizeof(sh->numEvictions));
+    sh->numDirtyEvictions = 0;
+    sh->numPinWaits = 0;
+    sh->pinWaitNanos = 0;
+    memset(sh->pinLatency, 0, sizeof(sh->pinLatency));
+    sh->numWaiters = 0;
+    return RC_OK;
+}
+
+
+// Background writer. Woken when the number of dirty frames crosses the
+// high watermark (or every WRITER_IDLE_MS), it walks the shards and writes
+// unpinned dirty frames until the count is back at the low watermark, so
+// pinPage rarely has to write a dirty victim itself. Each page is copied
+// under the shard latch and written under the I/O latch only; taking the
+// I/O latch before dropping the shard latch keeps a concurrent miss from
+// reading the page back before the write lands. The frame stays dirty
+// while the write is under way, so it cannot be dropped unwritten if the
+// write fails, and is only marked clean afterwards if it still holds the
+// page as it was copied. Sets *wrote if a page was written.
+static RC cleanOneFrame(BM_MgmtData *mgmt, BM_Shard *sh, bool *wrote) {
+    *wrote = false;
+    lockShard(mgmt, sh);
+    int total = sh->numFrames + sh->numWindow;
+    for (int n = 0; n < total; n++) {
+        Frame *f = &sh->frames[sh->writerCursor];
+        sh->writerCursor = (sh->writerCursor + 1) % total;
+        if (f->isDirty && fixCountOf(sh, f) == 0) {
+            PageNumber pageNum = f->pageNum;
+            unsigned int generation = f->generation;
+            memcpy(mgmt->writerBuffer, f->data, PAGE_SIZE);
+            lockIO(mgmt);
+            unlockShard(mgmt, sh);
+            RC rc = writeKey(mgmt, pageNum, mgmt->writerBuffer);
+            unlockIO(mgmt);
+
+            lockShard(mgmt, sh);
+            if (rc != RC_OK) {
+                sh->numWriteErrors++;
+            } else {
+                sh->numWriteIO++;
+                if (f->generation == generation && fixCountOf(sh, f) == 0 &&
+                    memcmp(f->data, mgmt->writerBuffer, PAGE_SIZE) == 0)
+                    setClean(mgmt, f);
+                *wrote = true;
+            }
+            unlockShard(mgmt, sh);
+            return rc;
+        }
+    }
+    unlockShard(mgmt, sh);
+    return RC_OK;
+}
+
+static int dirtyCount(BM_MgmtData *mgmt) {
+    return __atomic_load_n(&mgmt->numDirty, __ATOMIC_RELAXED);
+}
+
+static void *backgroundWriter(void *arg) {
+    BM_MgmtData *mgmt = (BM_MgmtData *)arg;
+    pthread_mutex_lock(&mgmt->writerLatch);
+    while (!mgmt->writerStop) {
+        if (dirtyCount(mgmt) <= __atomic_load_n(&mgmt->dirtyHigh, __ATOMIC_RELAXED)) {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += WRITER_IDLE_MS * 1000000L;
+            if (until.tv_nsec >= 1000000000L) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&mgmt->writerWake, &mgmt->writerLatch, &until);
+            continue;
+        }
+        pthread_mutex_unlock(&mgmt->writerLatch);
+
+        bool progress = true;
+        while (progress && !__atomic_load_n(&mgmt->writerStop, __ATOMIC_RELAXED) &&
+               dirtyCount(mgmt) > __atomic_load_n(&mgmt->dirtyLow, __ATOMIC_RELAXED)) {
+            progress = false;
+            for (int s = 0; s < mgmt->numShards; s++) {
+                // a failed write is counted in writeErrors; the page stays
+                // dirty, so forceFlushPool or its eviction writes it again
+                // and returns the error if it still fails
+                bool wrote;
+                cleanOneFrame(mgmt, &mgmt->shards[s], &wrote);
+                progress |= wrote;
+            }
+        }
+
+        pthread_mutex_lock(&mgmt->writerLatch);
+        // everything left is pinned; wait for the next tick
+        if (!progress && !mgmt->writerStop) {
+            pthread_mutex_unlock(&mgmt->writerLatch);
+            struct timespec idle = { 0, WRITER_IDLE_MS * 1000000L };
+            nanosleep(&idle, NULL);
+            pthread_mutex_lock(&mgmt->writerLatch);
+        }
+    }
+    pthread_mutex_unlock(&mgmt->writerLatch);
+    return NULL;
+}
+
+// The watermarks follow the pool size; resizeBufferPool changes them while
+// the writer runs.
+static void setDirtyMarks(BM_MgmtData *mgmt) {
+    int high = mgmt->numPages * mgmt->dirtyWatermark / 100;
+    __atomic_store_n(&mgmt->dirtyHigh, high, __ATOMIC_RELAXED);
+    __atomic_store_n(&mgmt->dirtyLow, high / 2, __ATOMIC_RELAXED);
+}
+
+static RC startWriter(BM_MgmtData *mgmt, const BM_PoolConfig *config) {
+    mgmt->dirtyWatermark = config->dirtyWatermark > 0 ? config->dirtyWatermark
+                                                      : DEFAULT_DIRTY_WATERMARK;
+    setDirtyMarks(mgmt);
+    mgmt->writerBuffer = malloc(PAGE_SIZE);
+    if (mgmt->writerBuffer == NULL) return RC_NOMEM;
+    mgmt->writerStop = false;
+    if (pthread_create(&mgmt->writer, NULL, backgroundWriter, mgmt) != 0)
+        return RC_ERROR;
+    mgmt->writerRunning = true;
+    return RC_OK;
+}
+
+static void stopWriter(BM_MgmtData *mgmt) {
+    if (!mgmt->writerRunning) return;
+    pthread_mutex_lock(&mgmt->writerLatch);
+    mgmt->writerStop = true;
+    pthread_cond_signal(&mgmt->writerWake);
+    pthread_mutex_unlock(&mgmt->writerLatch);
+    pthread_join(mgmt->writer, NULL);
+    mgmt->writerRunning = false;
+}
+
+// Tracing. Records are collected in traceBuffer under traceLatch and
+// written out whenever it fills up, and at shutdown.
+static RC startTrace(BM_MgmtData *mgmt, const char *fileName) {
+    mgmt->traceBuffer = malloc(TRACE_BUFFER_BYTES);
+    if (mgmt->traceBuffer == NULL) return RC_NOMEM;
+    mgmt->trace = fopen(fileName, "wb");
+    if (mgmt->trace == NULL) return RC_FILE_NOT_FOUND;
+    if (fwrite(BM_TRACE_MAGIC, 1, 8, mgmt->trace) != 8) return RC_WRITE_FAILED;
+    return RC_OK;
+}
+
+static void traceFlush(BM_MgmtData *mgmt) {
+    fwrite(mgmt->traceBuffer, 1, mgmt->traceBytes, mgmt->trace);
+    mgmt->traceBytes = 0;
+}
+
+static void traceRecord(BM_MgmtData *mgmt, PageNumber key, unsigned int op) {
+    if (mgmt->trace == NULL) return;
+    uint32_t record = (uint32_t)key << 1 | op;
+    if (mgmt->latching) pthread_mutex_lock(&mgmt->traceLatch);
+    unsigned char *out = mgmt->traceBuffer + mgmt->traceBytes;
+    out[0] = record & 0xFF;
+    out[1] = record >> 8 & 0xFF;
+    out[2] = record >> 16 & 0xFF;
+    out[3] = record >> 24;
+    mgmt->traceBytes += 4;
+    if (mgmt->traceBytes == TRACE_BUFFER_BYTES) traceFlush(mgmt);
+    if (mgmt->latching) pthread_mutex_unlock(&mgmt->traceLatch);
+}
+
+static void stopTrace(BM_MgmtData *mgmt) {
+    if (mgmt->trace != NULL) {
+        traceFlush(mgmt);
+        fclose(mgmt->trace);
+    }
+    free(mgmt->traceBuffer);
+}
+
+RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName,
 		const int numPages, ReplacementStrategy strategy, void *stratData) {
+    return initBufferPoolWithConfig(bm, pageFileName, numPages, strategy,
+                                    stratData, NULL);
+}
+
+// Free everything createPool allocated. Whatever it had not got to yet is
+// still NULL, so this also unwinds a pool whose creation failed part way.
+// The pool's threads must have been stopped.
+static void freePool(BM_MgmtData *mgmt) {
+    for (int s = 0; mgmt->shards != NULL && s < mgmt->numShards; s++) {
+        BM_Shard *sh = &mgmt->shards[s];
+        free(sh->frames);
+        free(sh->fixCounts);
+        free(sh->refBits);
+        free(sh->sketch.counters);
+        free(sh->pageTable.slots);
+        free(sh->lfuBuckets);
+        free(sh->lrukHeap);
+        free(sh->lrukHistoryStore);
+        ghostFree(&sh->lrukHistory);
+        ghostFree(&sh->arcGhosts);
+        ghostFree(&sh->q2A1out);
+        pthread_mutex_destroy(&sh->latch);
+        pthread_cond_destroy(&sh->loadDone);
+    }
+    free(mgmt->shards);
+    if (mgmt->arena != NULL) munmap(mgmt->arena, mgmt->arenaSize);
+    free(mgmt->pageLatches);
+    free(mgmt->writerBuffer);
+    free(mgmt->flushFrames);
+    pthread_mutex_destroy(&mgmt->ioLatch);
+    pthread_mutex_destroy(&mgmt->writerLatch);
+    pthread_cond_destroy(&mgmt->writerWake);
+    free(mgmt->prefetchQueue);
+    pthread_mutex_destroy(&mgmt->prefetchLatch);
+    pthread_cond_destroy(&mgmt->prefetchWake);
+    pthread_mutex_destroy(&mgmt->raLatch);
+    pthread_mutex_destroy(&mgmt->traceLatch);
+    free(mgmt->warmFile);
+
+    int numFiles = mgmt->shared ? BM_MAX_FILES : 1;
+    for (int i = 0; mgmt->files != NULL && i < numFiles; i++) {
+        BM_FileMgmt *file = &mgmt->files[i];
+        if (file->refCount == 0) continue;
+        closePageFile(&file->fh);
+        free(file->name);
+    }
+    free(mgmt->files);
+    free(mgmt);
+}
+
+// Allocate the file table, shards and arena of a pool whose settings
+// createPool has filled in, then open the trace and start the writer. The
+// trace comes first, so a trace file that cannot be created leaves no
+// thread behind.
+static RC startPool(BM_MgmtData *mgmt, ReplacementStrategy strategy, void *stratData,
+                    const BM_PoolConfig *config, int numFiles) {
+    mgmt->files = calloc(numFiles, sizeof(BM_FileMgmt));
+    mgmt->flushFrames = malloc(sizeof(Frame *) * mgmt->maxPages);
+    mgmt->shards = calloc(mgmt->numShards, sizeof(BM_Shard));
+    if (mgmt->files == NULL || mgmt->flushFrames == NULL || mgmt->shards == NULL)
+        return RC_NOMEM;
+    for (int s = 0; s < mgmt->numShards; s++) {
+        pthread_mutex_init(&mgmt->shards[s].latch, NULL);
+        pthread_cond_init(&mgmt->shards[s].loadDone, NULL);
+    }
+
+    RC rc = allocArena(mgmt);
+    if (rc != RC_OK) return rc;
+    for (int s = 0; s < mgmt->numShards; s++) {
+        int count = (mgmt->numPages - s + mgmt->numShards - 1) / mgmt->numShards;
+        int capacity = (mgmt->maxPages - s + mgmt->numShards - 1) / mgmt->numShards;
+        rc = initShard(&mgmt->shards[s], s, mgmt->numShards, count, capacity,
+                       mgmt->arena, strategy, stratData, config);
+        if (rc != RC_OK) return rc;
+    }
+    if (config != NULL && config->traceFile != NULL) {
+        rc = startTrace(mgmt, config->traceFile);
+        if (rc != RC_OK) return rc;
+    }
+    if (config != NULL && config->backgroundWriter) {
+        rc = startWriter(mgmt, config);
+        if (rc != RC_OK) return rc;
+    }
+    return RC_OK;
+}
+
+// Frames and threads of a pool with a table of numFiles file slots. On
+// failure everything created so far is stopped and freed again.
+static RC createPool(BM_BufferPool *const bm, const int numPages, ReplacementStrategy strategy,
+                     void *stratData, const BM_PoolConfig *config, int numFiles) {
+    BM_MgmtData *mgmt = calloc(1, sizeof(BM_MgmtData));
+    if (mgmt == NULL) return RC_NOMEM;
+    mgmt->shared = numFiles > 1;
+    mgmt->numPages = numPages;
+    mgmt->maxPages = numPages;
+    if (config != NULL && !config->admission && config->maxPages > numPages)
+        mgmt->maxPages = config->maxPages;
+    mgmt->numShards = chooseNumShards(config, numPages);
+    mgmt->latching = config != NULL && (config->concurrent || config->backgroundWriter);
+    pthread_mutex_init(&mgmt->ioLatch, NULL);
+    mgmt->numDirty = 0;
+    mgmt->numWritesSaved = 0;
+    mgmt->writerRunning = false;
+    mgmt->writerBuffer = NULL;
+    pthread_mutex_init(&mgmt->writerLatch, NULL);
+    pthread_cond_init(&mgmt->writerWake, NULL);
+    mgmt->prefetchQueue = NULL;
+    mgmt->prefetchHead = 0;
+    mgmt->prefetchCount = 0;
+    mgmt->prefetcherRunning = false;
+    pthread_mutex_init(&mgmt->prefetchLatch, NULL);
+    pthread_cond_init(&mgmt->prefetchWake, NULL);
+    mgmt->readAhead = config != NULL && config->readAhead;
+    mgmt->maxReadAhead = config != NULL && config->maxReadAhead > 0 ? config->maxReadAhead
+                                                                    : DEFAULT_MAX_READ_AHEAD;
+    if (mgmt->maxReadAhead > numPages / 4) mgmt->maxReadAhead = numPages / 4;
+    mgmt->raLast = NO_PAGE;
+    mgmt->raRun = 0;
+    mgmt->raWindow = 0;
+    mgmt->raEnd = 0;
+    pthread_mutex_init(&mgmt->raLatch, NULL);
+    mgmt->warmFile = NULL;
+    mgmt->pinLatency = config != NULL && config->pinLatency;
+    mgmt->trace = NULL;
+    mgmt->traceBuffer = NULL;
+    mgmt->traceBytes = 0;
+    pthread_mutex_init(&mgmt->traceLatch, NULL);
+
+    RC rc = startPool(mgmt, strategy, stratData, config, numFiles);
+    if (rc != RC_OK) {
+        stopWriter(mgmt);
+        stopPrefetcher(mgmt);
+        stopTrace(mgmt);
+        freePool(mgmt);
+        return rc;
+    }
+
+    bm->numPages = numPages;
+    bm->strategy = strategy;
+    bm->mgmtData = mgmt;
+    return RC_OK;
+}
+
+static RC dumpPool(BM_BufferPool *const bm);
+static void warmPool(BM_BufferPool *const bm);
+
+RC initBufferPoolWithConfig(BM_BufferPool *const bm, const char *const pageFileName,
+		const int numPages, ReplacementStrategy strategy,
+		void *stratData, const BM_PoolConfig *config) {
+
+    if (numPages <= 0) return RC_ERROR;
+
+    SM_FileHandle fh;
+    RC rc = openPageFile((char *)pageFileName, &fh);
+    if (rc != RC_OK) return rc;
+
+    rc = createPool(bm, numPages, strategy, stratData, config, 1);
+    if (rc != RC_OK) {
+        closePageFile(&fh);
+        return rc;
+    }
+    BM_MgmtData *mgmt = (BM_MgmtData *)bm->mgmtData;
+    mgmt->files[0].fh = fh;
+    mgmt->files[0].name = strdup(pageFileName);
+    mgmt->files[0].refCount = 1;
+    bm->pageFile = strdup(pageFileName);
+    bm->fileId = 0;
+    if (mgmt->files[0].name == NULL || bm->pageFile == NULL) {
+        shutdownBufferPool(bm);
+        return RC_NOMEM;
+    }
+    if (config != NULL && config->warmFile != NULL) {
+        mgmt->warmFile = strdup(config->warmFile);
+        warmPool(bm);
+    }
+    return RC_OK;
+}
+
+
+static RC detachBufferPool(BM_BufferPool *const bm);
+
+RC shutdownBufferPool(BM_BufferPool *const bm) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    if (mgmtData == NULL) return RC_FILE_HANDLE_NOT_INIT;
+    if (mgmtData->shared && bm->fileId >= 0) return detachBufferPool(bm);
+
+    stopPrefetcher(mgmtData);
+    stopWriter(mgmtData);
+    RC rc = forceFlushPool(bm);
+    if (mgmtData->warmFile != NULL) dumpPool(bm);
+    stopTrace(mgmtData);
+    freePool(mgmtData);
+    free(bm->pageFile);
+    bm->mgmtData = NULL;
+    return rc;
+}
+
+
+static void shardLockAll(BM_MgmtData *mgmt);
+static void shardUnlockAll(BM_MgmtData *mgmt);
+
+static int compareFrameKey(const void *a, const void *b) {
+    PageNumber x = (*(Frame *const *)a)->pageNum, y = (*(Frame *const *)b)->pageNum;
+    return (x > y) - (x < y);
+}
+
+// Write frames[0..n), consecutive pages of one file, with one call. Called
+// with every shard and the I/O latch held.
+static RC writeRun(BM_MgmtData *mgmt, Frame **frames, int n) {
+    BM_FileMgmt *file = keyFile(mgmt, frames[0]->pageNum);
+    if (file->refCount == 0) return RC_FILE_HANDLE_NOT_INIT;
+    SM_PageHandle buffers[FLUSH_MAX_RUN];
+    for (int i = 0; i < n; i++) buffers[i] = frames[i]->data;
+    RC rc = writeBlocks(keyPage(mgmt, frames[0]->pageNum), n, &file->fh, buffers);
+    if (rc != RC_OK) return rc;
+    file->numWriteIO += n;
+    file->numWritesSaved += n - 1;
+    mgmt->numWritesSaved += n - 1;
+    for (int i = 0; i < n; i++) {
+        shardFor(mgmt, frames[i]->pageNum)->numWriteIO++;
+        setClean(mgmt, frames[i]);
+    }
+    return RC_OK;
+}
+
+// The dirty unpinned frames are written in page order, each run of
+// consecutive pages of a file with one writeBlocks call, instead of one
+// random write per frame in frame order. All shards stay latched until the
+// writes are done, since a page that looked clean could otherwise be
+// evicted and read back before its write landed. flushLatched writes the
+// pages of bm's file, or of every file if allFiles is set, with all shards
+// latched.
+static RC flushLatched(BM_BufferPool *const bm, bool allFiles) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    Frame **dirty = mgmtData->flushFrames;
+    int n = 0;
+    for (int s = 0; s < mgmtData->numShards; s++) {
+        BM_Shard *sh = &mgmtData->shards[s];
+        for (int i = 0; i < sh->numFrames + sh->numWindow; i++) {
+            Frame *curr = &sh->frames[i];
+            if (curr->isDirty && fixCountOf(sh, curr) == 0 && (allFiles || frameOfFile(bm, curr)))
+                dirty[n++] = curr;
+        }
+    }
+    qsort(dirty, n, sizeof(Frame *), compareFrameKey);
+
+    RC rc = RC_OK;
+    lockIO(mgmtData);
+    for (int i = 0; i < n;) {
+        int run = 1;
+        while (i + run < n && run < FLUSH_MAX_RUN &&
+               dirty[i + run]->pageNum == dirty[i]->pageNum + run &&
+               keyFile(mgmtData, dirty[i + run]->pageNum) == keyFile(mgmtData, dirty[i]->pageNum))
+            run++;
+        RC runRc = writeRun(mgmtData, dirty + i, run);
+        if (runRc != RC_OK) rc = runRc;
+        i += run;
+    }
+    unlockIO(mgmtData);
+    return rc;
+}
+
+RC forceFlushPool(BM_BufferPool *const bm) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    if (mgmtData == NULL) return RC_FILE_HANDLE_NOT_INIT;
+
+    shardLockAll(mgmtData);
+    RC rc = flushLatched(bm, false);
+    shardUnlockAll(mgmtData);
+    return rc;
+}
+
+// Page latches. pinPageLatched latches a page shared or exclusive on top
+// of pinning it. The latch word belongs to the page's block of the arena
+// rather than to its frame, because a resize may move a pinned page to
+// another frame but keeps its data where the caller sees it. Bit 0 is set
+// while the page is held exclusive and bit 1 while a writer is waiting,
+// which holds off new readers so writers are not starved; the next 20
+// bits count shared holders and the rest is a version that every
+// exclusive release advances. Latches only order the threads that take
+// them: the pool itself writes back and evicts unpinned pages only, which
+// no one can hold a latch on.
+#define LATCH_EXCLUSIVE ((uint64_t)1)
+#define LATCH_WRITER_WAITING ((uint64_t)2)
+#define LATCH_SHARED ((uint64_t)4)
+#define LATCH_SHARED_MASK ((((uint64_t)1 << 20) - 1) * LATCH_SHARED)
+#define LATCH_VERSION ((uint64_t)1 << 22)
+#define LATCH_SPINS 64
+
+static uint64_t *latchWord(BM_MgmtData *mgmt, const char *data) {
+    return &mgmt->pageLatches[(data - mgmt->arena) / PAGE_SIZE];
+}
+
+// Spin briefly, then give the CPU to the holder.
+static void latchBackoff(int *spins) {
+    if (++*spins < LATCH_SPINS) return;
+    *spins = 0;
+    sched_yield();
+}
+
+static void latchShared(uint64_t *word) {
+    int spins = 0;
+    uint64_t w = __atomic_load_n(word, __ATOMIC_RELAXED);
+    for (;;) {
+        if ((w & (LATCH_EXCLUSIVE | LATCH_WRITER_WAITING)) == 0) {
+            if (__atomic_compare_exchange_n(word, &w, w + LATCH_SHARED, true,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                return;
+            continue;
+        }
+        latchBackoff(&spins);
+        w = __atomic_load_n(word, __ATOMIC_RELAXED);
+    }
+}
+
+static void latchExclusive(uint64_t *word) {
+    int spins = 0;
+    uint64_t w = __atomic_load_n(word, __ATOMIC_RELAXED);
+    for (;;) {
+        if ((w & (LATCH_EXCLUSIVE | LATCH_SHARED_MASK)) == 0) {
+            uint64_t held = (w | LATCH_EXCLUSIVE) & ~LATCH_WRITER_WAITING;
+            if (__atomic_compare_exchange_n(word, &w, held, true,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                return;
+            continue;
+        }
+        if ((w & LATCH_WRITER_WAITING) == 0)
+            __atomic_or_fetch(word, LATCH_WRITER_WAITING, __ATOMIC_RELAXED);
+        latchBackoff(&spins);
+        w = __atomic_load_n(word, __ATOMIC_RELAXED);
+    }
+}
+
+// Drop the latch page holds, if any. Hand-made handles may carry anything
+// in latch, so only a data pointer into the arena is trusted.
+static void releaseLatch(BM_MgmtData *mgmt, BM_PageHandle *page) {
+    if (page->latch == BM_LATCH_NONE) return;
+    if (page->data >= mgmt->arena &&
+        page->data < mgmt->arena + (size_t)mgmt->maxPages * PAGE_SIZE) {
+        uint64_t *word = latchWord(mgmt, page->data);
+        if (page->latch == BM_LATCH_SHARED)
+            __atomic_sub_fetch(word, LATCH_SHARED, __ATOMIC_RELEASE);
+        else if (page->latch == BM_LATCH_EXCLUSIVE)
+            __atomic_add_fetch(word, LATCH_VERSION - LATCH_EXCLUSIVE, __ATOMIC_RELEASE);
+    }
+    page->latch = BM_LATCH_NONE;
+}
+
+// Pin pageNum and latch it in mode, waiting for conflicting holders.
+// unpinPage releases the latch. A thread must not latch a page it already
+// holds a latch on: a waiting writer would keep its second shared request
+// out for good.
+RC pinPageLatched(BM_BufferPool *const bm, BM_PageHandle *const page,
+                  const PageNumber pageNum, const BM_LatchMode mode) {
+    return pinPageWithRingLatched(bm, page, pageNum, NULL, mode);
+}
+
+// pinPageLatched for a bulk reader: misses recycle the frames of ring, as in
+// pinPageWithRing.
+RC pinPageWithRingLatched(BM_BufferPool *const bm, BM_PageHandle *const page,
+                          const PageNumber pageNum, BM_AccessRing *const ring,
+                          const BM_LatchMode mode) {
+    if (mode != BM_LATCH_NONE && mode != BM_LATCH_SHARED && mode != BM_LATCH_EXCLUSIVE)
+        return RC_ERROR;
+    RC rc = pinPageWithRing(bm, page, pageNum, ring);
+    if (rc != RC_OK || mode == BM_LATCH_NONE) return rc;
+
+    uint64_t *word = latchWord((BM_MgmtData *)bm->mgmtData, page->data);
+    if (mode == BM_LATCH_SHARED) latchShared(word);
+    else latchExclusive(word);
+    page->latch = mode;
+    return RC_OK;
+}
+
+// Optimistic reads. startOptimisticRead finds a resident page without
+// pinning it or taking any latch and returns the version of its latch word;
+// the caller reads page->data and then calls validateOptimisticRead, which
+// fails if the page was latched exclusive, reloaded or moved meanwhile.
+// Neither call writes to shared memory, so readers of a hot page do not
+// contend. What was read must be thrown away unless validation succeeds,
+// and writers of such pages must modify them under BM_LATCH_EXCLUSIVE.
+#define LATCH_VERSION_MASK (~(LATCH_WRITER_WAITING | LATCH_SHARED_MASK))
+#define OPTIMISTIC_RETRIES 8
+
+RC startOptimisticRead(BM_BufferPool *const bm, BM_PageHandle *const page,
+                       const PageNumber pageNum, uint64_t *const version) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    if (mgmtData == NULL) return RC_FILE_HANDLE_NOT_INIT;
+    if (pageNum < 0) return RC_READ_NON_EXISTING_PAGE;
+    PageNumber key = pageKey(bm, pageNum);
+    if (key == NO_PAGE) return RC_READ_NON_EXISTING_PAGE;
+
+    BM_Shard *sh = shardFor(mgmtData, key);
+    int idx = lookupFrameUnlatched(sh, key);
+    if (idx == EMPTY_SLOT) return RC_BUFFER_PAGE_NOT_RESIDENT;
+    Frame *f = &sh->frames[idx];
+    unsigned int gen = __atomic_load_n(&f->generation, __ATOMIC_ACQUIRE);
+    char *data = __atomic_load_n(&f->data, __ATOMIC_RELAXED);
+    uint64_t w = __atomic_load_n(latchWord(mgmtData, data), __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&f->pageNum, __ATOMIC_RELAXED) != key ||
+        __atomic_load_n(&f->generation, __ATOMIC_RELAXED) != gen)
+        return RC_BUFFER_PAGE_NOT_RESIDENT;
+    if (w & LATCH_EXCLUSIVE) return RC_BUFFER_PAGE_BUSY;
+
+    page->pageNum = pageNum;
+    page->data = data;
+    page->frame = f->id;
+    page->frameGen = gen;
+    page->latch = BM_LATCH_NONE;
+    *version = w & LATCH_VERSION_MASK;
+    return RC_OK;
+}
+
+bool validateOptimisticRead(BM_BufferPool *const bm, BM_PageHandle *const page,
+                            const uint64_t version) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    // order the caller's reads of the page before the checks
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t w = __atomic_load_n(latchWord(mgmtData, page->data), __ATOMIC_RELAXED);
+    if ((w & LATCH_VERSION_MASK) != version) return false;
+    Frame *f = frameAt(mgmtData, page->frame);
+    return __atomic_load_n(&f->generation, __ATOMIC_RELAXED) == page->frameGen &&
+           __atomic_load_n(&f->data, __ATOMIC_RELAXED) == page->data;
+}
+
+// Copy pageNum into buf, optimistically while that keeps succeeding, and
+// otherwise (page not resident, or still changing after a few retries)
+// under a shared latch.
+RC readPageOptimistic(BM_BufferPool *const bm, const PageNumber pageNum, char *const buf) {
+    BM_PageHandle h;
+    uint64_t version;
+
+    for (int attempt = 0; attempt < OPTIMISTIC_RETRIES; attempt++) {
+        RC rc = startOptimisticRead(bm, &h, pageNum, &version);
+        if (rc == RC_BUFFER_PAGE_BUSY) {
+            sched_yield();
+            continue;
+        }
+        if (rc != RC_OK) break;
+        memcpy(buf, h.data, PAGE_SIZE);
+        if (validateOptimisticRead(bm, &h, version)) return RC_OK;
+    }
+
+    RC rc = pinPageLatched(bm, &h, pageNum, BM_LATCH_SHARED);
+    if (rc != RC_OK) return rc;
+    memcpy(buf, h.data, PAGE_SIZE);
+    return unpinPage(bm, &h);
+}
+
+RC markDirty(BM_BufferPool *const bm, BM_PageHandle *const page) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    if (mgmtData == NULL) return RC_FILE_HANDLE_NOT_INIT;
+
+    PageNumber key = pageKey(bm, page->pageNum);
+    BM_Shard *sh = shardFor(mgmtData, key);
+    lockShard(mgmtData, sh);
+    Frame *curr = resolveFrame(mgmtData, sh, page, key);
+    if (curr != NULL) setDirty(mgmtData, curr);
+    unlockShard(mgmtData, sh);
+    return curr != NULL ? RC_OK : RC_ERROR;
+}
+
+RC unpinPage(BM_BufferPool *const bm, BM_PageHandle *const page) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    if (mgmtData == NULL) return RC_FILE_HANDLE_NOT_INIT;
+
+    // A handle from pinPage names a frame that cannot be evicted while the
+    // caller still holds the pin, so it is safe to use without a latch as
+    // long as the strategy keeps no per-unpin state.
+    bool tracksUnpin = bm->strategy == RS_LRU || bm->strategy == RS_LRU_K;
+    PageNumber key = pageKey(bm, page->pageNum);
+    Frame *curr = handleFrame(mgmtData, page, key);
+    if (curr != NULL) releaseLatch(mgmtData, page);
+    if (curr != NULL && !tracksUnpin &&
+        unfixFrame(&mgmtData->shards[page->frame % mgmtData->numShards], curr) >= 0) {
+        traceRecord(mgmtData, key, BM_TRACE_UNPIN);
+        return RC_OK;
+    }
+
+    BM_Shard *sh = shardFor(mgmtData, key);
+    lockShard(mgmtData, sh);
+    curr = resolveFrame(mgmtData, sh, page, key);
+    if (curr != NULL) releaseLatch(mgmtData, page);
+    if (curr != NULL && unfixFrame(sh, curr) == 0)
+        strategyUnpinned(bm, sh, curr);
+    unlockShard(mgmtData, sh);
+    if (curr == NULL) return RC_ERROR;
+    traceRecord(mgmtData, key, BM_TRACE_UNPIN);
+    return RC_OK;
+}
+
+RC forcePage(BM_BufferPool *const bm, BM_PageHandle *const page) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    if (mgmtData == NULL) return RC_FILE_HANDLE_NOT_INIT;
+
+    PageNumber key = pageKey(bm, page->pageNum);
+    BM_Shard *sh = shardFor(mgmtData, key);
+    lockShard(mgmtData, sh);
+    Frame *curr = resolveFrame(mgmtData, sh, page, key);
+    if (curr == NULL) {
+        unlockShard(mgmtData, sh);
+        return RC_ERROR;
+    }
+    RC rc = writeFrame(mgmtData, sh, curr);
+    unlockShard(mgmtData, sh);
+    return rc;
+}
+
+// Victim selection. Each strategy only looks at the frames of one shard and
+// is called with that shard's latch held.
+
+// CLOCK works through the reference bits a word (64 frames) at a time:
+// the unpinned frames of the word are gathered from the dense fix counts,
+// the first unpinned frame at or after the hand without its bit is the
+// victim, and every unpinned frame the hand passes loses its bit. Pinned
+// frames keep theirs. Two turns of the hand find a victim if any frame is
+// unpinned.
+static uint64_t unpinnedMask(BM_Shard *sh, int base, int from, int to) {
+    uint64_t mask = 0;
+    for (int i = from; i < to; i++) {
+        if (fixCountAt(sh, base + i) == 0) mask |= (uint64_t)1 << i;
+    }
+    return mask;
+}
+
+static Frame *selectVictimClock(BM_Shard *sh) {
+    int n = sh->numFrames;
+    int scanned = 0;
+    while (scanned < 2 * n) {
+        int hand = sh->clockHand;
+        int base = hand & ~63;
+        int from = hand - base;
+        int to = n - base < 64 ? n - base : 64;
+        uint64_t *word = &sh->refBits[base / 64];
+        uint64_t unpinned = unpinnedMask(sh, base, from, to);
+        uint64_t candidates = unpinned & ~*word;
+        if (candidates != 0) {
+            int bit = __builtin_ctzll(candidates);
+            *word &= ~(unpinned & (((uint64_t)1 << bit) - 1));
+            sh->clockHand = (base + bit + 1) % n;
+            return &sh->frames[base + bit];
+        }
+        *word &= ~unpinned;
+        scanned += to - from;
+        sh->clockHand = (base + to) % n;
+    }
+    return NULL;
+}
+
+static Frame *selectVictimFIFO(BM_Shard *sh) {
+    for (int n = 0; n < sh->numFrames; n++) {
+        Frame *ptr = &sh->frames[(sh->fifoPtr + n) % sh->numFrames];
+        if (fixCountOf(sh, ptr) == 0) return ptr;
+    }
+    return NULL;
+}
+
+// LRU recency list. Only unpinned frames are linked: unpinPage pushes a
+// frame to the head when its fix count drops to 0, pinPage unlinks it, and
+// the victim is always the tail. Empty frames start on the list in index
+// order so they are used first.
+static Frame *selectVictimLRU(BM_Shard *sh) {
+    if (sh->lru.tail == EMPTY_SLOT) return NULL;
+    Frame *victim = &sh->frames[sh->lru.tail];
+    listUnlink(sh, victim);
+    return victim;
+}
+
+static Frame *selectVictimLFU(BM_Shard *sh) {
+    for (int b = sh->lfuFirst; b != EMPTY_SLOT; b = sh->lfuBuckets[b].next) {
+        for (int i = sh->lfuBuckets[b].tail; i != EMPTY_SLOT; i = sh->frames[i].listPrev) {
+            if (fixCountAt(sh, i) == 0) return &sh->frames[i];
+        }
+    }
+    return NULL;
+}
+
+static Frame *selectVictim(BM_BufferPool *const bm, BM_Shard *sh, PageNumber pageNum) {
+    switch (bm->strategy) {
+    case RS_CLOCK:
+        return selectVictimClock(sh);
+    case RS_FIFO:
+        return selectVictimFIFO(sh);
+    case RS_LRU:
+        return selectVictimLRU(sh);
+    case RS_LRU_K:
+        return selectVictimLRUK(sh);
+    case RS_LFU:
+        return selectVictimLFU(sh);
+    case RS_ARC:
+        return selectVictimARC(sh, pageNum);
+    case RS_2Q:
+        return selectVictim2Q(sh);
+    default:
+        return NULL;
+    }
+}
+
+static void touchFrame(BM_Shard *sh, Frame *f) {
+    int idx = (int)(f - sh->frames);
+    sh->refBits[idx / 64] |= (uint64_t)1 << (idx % 64);
+    f->lastUsed = ++sh->timestamp;
+}
+
+// Replacement bookkeeping for a pin that found its page resident. Frames in
+// the admission window are kept in LRU order outside the strategy.
+static void strategyHit(BM_BufferPool *const bm, BM_Shard *sh, Frame *f) {
+    if (inWindow(sh, f)) {
+        listUnlink(sh, f);
+        listPushFront(sh, &sh->window, f);
+    } else if (bm->strategy == RS_LRU) {
+        listUnlink(sh, f);
+    } else if (bm->strategy == RS_LFU) {
+        LFUBucket *bucket = &sh->lfuBuckets[f->lfuBucket];
+        lfuMove(sh, f, bucket->freq + 1, f->lfuBucket, true);
+        lfuCounted(sh);
+    } else if (bm->strategy == RS_LRU_K) {
+        lrukRemove(sh, f);
+        lrukReference(sh, f, sh->timestamp + 1);
+    } else if (bm->strategy == RS_ARC) {
+        listUnlink(sh, f);
+        listPushFront(sh, &sh->arcT2, f);
+    } else if (bm->strategy == RS_2Q) {
+        q2Hit(sh, f);
+    }
+    touchFrame(sh, f);
+}
+
+// Replacement bookkeeping for a page just read into victim frame f.
+static void strategyLoaded(BM_BufferPool *const bm, BM_Shard *sh, Frame *f) {
+    if (inWindow(sh, f)) {
+        listUnlink(sh, f);
+        listPushFront(sh, &sh->window, f);
+    } else if (bm->strategy == RS_FIFO) {
+        sh->fifoPtr = (int)(f - sh->frames + 1) % sh->numFrames;
+    } else if (bm->strategy == RS_LFU) {
+        lfuMove(sh, f, 1, EMPTY_SLOT, true);
+        lfuCounted(sh);
+    } else if (bm->strategy == RS_LRU_K) {
+        lrukLoaded(sh, f, sh->timestamp + 1);
+    } else if (bm->strategy == RS_ARC) {
+        arcLoaded(sh, f);
+    } else if (bm->strategy == RS_2Q) {
+        q2Loaded(sh, f);
+    }
+    touchFrame(sh, f);
+}
+
+// The victim was emptied but the new page could not be read; make the
+// frame the next one to reuse.
+static void strategyEmptied(BM_BufferPool *const bm, BM_Shard *sh, Frame *f) {
+    if (inWindow(sh, f)) {
+        listUnlink(sh, f);
+        listPushBack(sh, &sh->window, f);
+    } else if (bm->strategy == RS_LRU) {
+        listPushBack(sh, &sh->lru, f);
+    } else if (bm->strategy == RS_LFU) {
+        lfuMove(sh, f, 0, EMPTY_SLOT, false);
+    } else if (bm->strategy == RS_LRU_K) {
+        lrukEmptied(sh, f);
+    } else if (bm->strategy == RS_ARC || bm->strategy == RS_2Q) {
+        listUnlink(sh, f);
+        listPushFront(sh, &sh->freeFrames, f);
+    }
+}
+
+// Victim f is about to give up its page.
+static void strategyEvicted(BM_BufferPool *const bm, BM_Shard *sh, Frame *f) {
+    if (inWindow(sh, f)) return;
+    if (bm->strategy == RS_LRU_K) lrukEvicted(sh, f);
+    else if (bm->strategy == RS_ARC) arcEvicted(sh, f);
+    else if (bm->strategy == RS_2Q) q2Evicted(sh, f);
+}
+
+// The fix count of f dropped to 0.
+static void strategyUnpinned(BM_BufferPool *const bm, BM_Shard *sh, Frame *f) {
+    if (inWindow(sh, f)) return;
+    if (bm->strategy == RS_LRU) listPushFront(sh, &sh->lru, f);
+    else if (bm->strategy == RS_LRU_K) lrukPush(sh, f);
+}
+
+// A victim returned by selectVictim was not used after all; strategies that
+// take the victim off their list put it back as the next candidate.
+static void strategyKept(BM_BufferPool *const bm, BM_Shard *sh, Frame *f) {
+    if (inWindow(sh, f)) return;
+    if (bm->strategy == RS_LRU) listPushBack(sh, &sh->lru, f);
+    else if (bm->strategy == RS_LRU_K) lrukPush(sh, f);
+}
+
+// Write back and unmap the page held by frame f, if any, counting the
+// eviction under reason. If the write fails the page stays in f, dirty,
+// and the error is returned.
+static RC evictFrame(BM_BufferPool *const bm, BM_Shard *sh, Frame *f, BM_EvictReason reason) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    bool dirty = f->isDirty;
+    if (dirty) {
+        RC rc = writeFrame(mgmtData, sh, f);
+        if (rc != RC_OK) return rc;
+    }
+    if (f->pageNum != NO_PAGE) {
+        sh->numEvictions[reason]++;
+        if (dirty) sh->numDirtyEvictions++;
+        strategyEvicted(bm, sh, f);
+        removePageEntry(mgmtData, sh, f->pageNum);
+        setFramePage(f, NO_PAGE);
+    }
+    if (f->prefetched) {
+        sh->numPrefetchWasted++;
+        f->prefetched = false;
+    }
+    return RC_OK;
+}
+
+// Free a window frame for a new page. The page leaving the window moves
+// into the strategy's victim frame if the sketch rates it more frequently
+// used than the victim's page, and is dropped otherwise. If every window
+// frame is pinned the new page goes straight to the strategy's victim.
+static Frame *selectWindowVictim(BM_BufferPool *const bm, BM_Shard *sh, PageNumber pageNum,
+                                 BM_EvictReason reason) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    Frame *w = leastRecentUnpinned(sh, &sh->window);
+    if (w == NULL) return selectVictim(bm, sh, pageNum);
+    if (w->pageNum == NO_PAGE) return w;
+
+    PageNumber candidate = w->pageNum;
+    Frame *v = selectVictim(bm, sh, candidate);
+    if (v != NULL && v->pageNum != NO_PAGE &&
+        sketchEstimate(&sh->sketch, candidate) <= sketchEstimate(&sh->sketch, v->pageNum)) {
+        strategyKept(bm, sh, v);
+        v = NULL;
+    }
+    if (v == NULL) {
+        sh->numAdmissionRejects++;
+        return w;
+    }
+
+    // admit: hand the window frame's buffer to the victim frame, unless the
+    // victim's page cannot be written back, in which case it stays
+    if (evictFrame(bm, sh, v, reason) != RC_OK) {
+        strategyKept(bm, sh, v);
+        return w;
+    }
+    swapFrameData(v, w);
+    v->isDirty = w->isDirty;
+    w->isDirty = false;
+    removePageEntry(mgmtData, sh, candidate);
+    setFramePage(w, NO_PAGE);
+    nextGeneration(w);
+    setFramePage(v, candidate);
+    nextGeneration(v);
+    insertPageEntry(mgmtData, sh, (int)(v - sh->frames));
+    strategyLoaded(bm, sh, v);
+    strategyUnpinned(bm, sh, v);
+    return w;
+}
+
+// Pin timing. Waits are timed only when a pin actually blocks; the whole
+// pin only when the pool was created with pinLatency, since reading the
+// clock costs about as much as a hit.
+static uint64_t nowNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// lockShard for a pin, counting the time it spends blocked.
+static void lockShardForPin(BM_MgmtData *mgmt, BM_Shard *sh) {
+    if (!mgmt->latching || pthread_mutex_trylock(&sh->latch) == 0) return;
+    uint64_t start = nowNanos();
+    pthread_mutex_lock(&sh->latch);
+    sh->numPinWaits++;
+    sh->pinWaitNanos += nowNanos() - start;
+}
+
+// Count a pin that started at start (ns) in the latency histogram.
+static void pinTimed(BM_MgmtData *mgmt, BM_Shard *sh, uint64_t start) {
+    if (!mgmt->pinLatency) return;
+    uint64_t nanos = nowNanos() - start;
+    int bucket = nanos == 0 ? 0 : 63 - __builtin_clzll(nanos);
+    if (bucket >= BM_LATENCY_BUCKETS) bucket = BM_LATENCY_BUCKETS - 1;
+    sh->pinLatency[bucket]++;
+}
+
+// A frame whose read failed is unmapped; whoever drops the last fix on it
+// hands it back to the strategy as empty.
+static void releaseFailed(BM_BufferPool *const bm, BM_Shard *sh, Frame *f) {
+    if (unfixFrame(sh, f) == 0) strategyEmptied(bm, sh, f);
+}
+
+// Wait (with the shard latch held) until a frame found in the page table
+// has finished loading; the caller has already fixed it.
+static RC waitLoaded(BM_BufferPool *const bm, BM_Shard *sh, Frame *f, PageNumber pageNum) {
+    if (f->loading) {
+        uint64_t start = nowNanos();
+        sh->numWaiters++;
+        while (f->loading)
+            pthread_cond_wait(&sh->loadDone, &sh->latch);
+        // a resize waits for the last waiter to leave
+        if (--sh->numWaiters == 0) pthread_cond_broadcast(&sh->loadDone);
+        sh->numPinWaits++;
+        sh->pinWaitNanos += nowNanos() - start;
+    }
+    if (f->pageNum == pageNum) return RC_OK;
+    releaseFailed(bm, sh, f);
+    return RC_READ_NON_EXISTING_PAGE;
+}
 
-    SM_FileHandle *fHandle = malloc(sizeof(SM_FileHandle));
-    RC rc = openPageFile((char *)pageFileName, fHandle);
-    if (rc != RC_OK) return rc;
+// Map pageNum into victim, a frame already taken off the strategy's victim
+// lists, before its read: the frame is fixed and marked loading, so other
+// pinners of the page wait for the read and the frame cannot be chosen as
+// a victim. Called with the shard latch held. Fails, leaving the victim
+// to the strategy, if its old page cannot be written back.
+static RC mapLoading(BM_BufferPool *const bm, BM_Shard *sh, Frame *victim,
+                     PageNumber pageNum, BM_EvictReason reason) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    RC rc = evictFrame(bm, sh, victim, reason);
+    if (rc != RC_OK) {
+        strategyKept(bm, sh, victim);
+        return rc;
+    }
 
-    BM_MgmtData *mgmt = malloc(sizeof(BM_MgmtData));
-    mgmt->fh = fHandle;  
-
-    mgmt->frames = malloc(sizeof(Frame) * numPages);
-
-    for (int i = 0; i < numPages; i++) {
-        mgmt->frames[i].pageNum = NO_PAGE;
-        mgmt->frames[i].fixCount = 0;
-        mgmt->frames[i].isDirty = false;
-        mgmt->frames[i].refCount = 0;
-        mgmt->frames[i].lastUsed = 0;
-        mgmt->frames[i].histIdx = 0;
-        for (int k = 0; k < K_VAL; k++) {
-            mgmt->frames[i].history[k] = 0;
-        }
-        mgmt->frames[i].referenceBit = false;
-        mgmt->frames[i].data = malloc(PAGE_SIZE);
-        if (mgmt->frames[i].data == NULL) {
-            printf("malloc for frame[%d].data failed\n", i);
-            return RC_ERROR;
-        }
+    // the buffer is latched exclusive while it is overwritten, which no one
+    // else can hold on an evicted page, before the new page becomes visible;
+    // optimistic readers of either page see the change
+    __atomic_add_fetch(latchWord(mgmtData, victim->data), LATCH_EXCLUSIVE, __ATOMIC_ACQ_REL);
+    setFramePage(victim, pageNum);
+    nextGeneration(victim);
+    victim->loading = true;
+    insertPageEntry(mgmtData, sh, (int)(victim - sh->frames));
+    *fixCountSlot(sh, victim) = 1;
+    strategyLoaded(bm, sh, victim);
+    return RC_OK;
+}
 
-        mgmt->frames[i].next = &mgmt->frames[(i + 1) % numPages];
+// End the load mapLoading started, rc being the result of the read. Called
+// with the shard latch held; a failed read unmaps the page again.
+static RC finishLoading(BM_BufferPool *const bm, BM_Shard *sh, Frame *victim,
+                        PageNumber pageNum, RC rc) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    __atomic_add_fetch(latchWord(mgmtData, victim->data), LATCH_VERSION - LATCH_EXCLUSIVE,
+                       __ATOMIC_RELEASE);
+    victim->loading = false;
+    if (mgmtData->latching) pthread_cond_broadcast(&sh->loadDone);
+    if (rc != RC_OK) {
+        removePageEntry(mgmtData, sh, pageNum);
+        setFramePage(victim, NO_PAGE);
+        releaseFailed(bm, sh, victim);
+        return rc;
     }
+    sh->numReadIO++;
+    return RC_OK;
+}
 
-    mgmt->clockHand = &mgmt->frames[0];
-    mgmt->fifoPtr = &mgmt->frames[0];
+// Read pageNum into victim (see mapLoading). Called and returns with the
+// shard latch held, but drops it around the read. On success the frame is
+// returned with a fix count of 1. Pages past the end of the file are added
+// when extend is set and are an error otherwise.
+static RC loadInto(BM_BufferPool *const bm, BM_Shard *sh, Frame *victim,
+                   PageNumber pageNum, bool extend, BM_EvictReason reason, Frame **loaded) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    RC rc = mapLoading(bm, sh, victim, pageNum, reason);
+    if (rc != RC_OK) return rc;
+    unlockShard(mgmtData, sh);
 
+    lockIO(mgmtData);
+    rc = readKey(mgmtData, pageNum, victim->data, extend);
+    unlockIO(mgmtData);
 
-    mgmt->numPages = numPages;
-    mgmt->readIO = 0;
-    mgmt->writeIO = 0;
-    mgmt->timestamp = 0;
+    lockShard(mgmtData, sh);
+    rc = finishLoading(bm, sh, victim, pageNum, rc);
+    if (rc == RC_OK) *loaded = victim;
+    return rc;
+}
 
-    bm->pageFile = strdup(pageFileName);
-    bm->numPages = numPages;
-    bm->strategy = strategy;
-    bm->mgmtData = mgmt;
+// Read pageNum into the frame the strategy picks as victim.
+static RC loadPage(BM_BufferPool *const bm, BM_Shard *sh, PageNumber pageNum,
+                   bool extend, BM_EvictReason reason, Frame **loaded) {
+    Frame *victim = sh->numWindow > 0 ? selectWindowVictim(bm, sh, pageNum, reason)
+                                      : selectVictim(bm, sh, pageNum);
+    if (victim == NULL) return RC_BUFFER_POOL_FULL;
+    return loadInto(bm, sh, victim, pageNum, extend, reason, loaded);
+}
 
-    return RC_OK;
+// Access rings. Each shard gets its share of the ring's slots, recycled
+// round-robin: a miss reuses the frame in the next slot if the ring still
+// owns it and otherwise loads through the strategy and records the frame it
+// got. A page pinned again by someone else is left to the strategy, so a
+// scan never takes frames from pages that are in use. Pages read ahead for
+// the scan are adopted into the ring when it reaches them, and the frame
+// they replace is emptied at once, so read-ahead does not widen the scan's
+// footprint beyond the ring and the read-ahead window.
+static RingSlot *ringSlot(BM_MgmtData *mgmt, BM_Shard *sh, BM_RingMgmt *rm, int n) {
+    return &rm->slots[(int)(sh - mgmt->shards) * rm->perShard + n];
 }
 
+static int *ringCursor(BM_MgmtData *mgmt, BM_Shard *sh, BM_RingMgmt *rm) {
+    return &rm->cursor[sh - mgmt->shards];
+}
 
-RC shutdownBufferPool(BM_BufferPool *const bm) {
-    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+// The slot's frame, if it can be recycled: unpinned and untouched since the
+// ring last used it.
+static Frame *ringOwned(BM_Shard *sh, RingSlot *slot) {
+    if (slot->frame == EMPTY_SLOT || slot->frame >= sh->numFrames + sh->numWindow) return NULL;
+    Frame *f = &sh->frames[slot->frame];
+    if (f->generation != slot->generation || f->lastUsed != slot->lastUsed) return NULL;
+    if (f->loading || fixCountOf(sh, f) != 0) return NULL;
+    return f;
+}
 
-    forceFlushPool(bm);
+static void ringRecord(BM_MgmtData *mgmt, BM_Shard *sh, BM_RingMgmt *rm, Frame *f) {
+    int *cursor = ringCursor(mgmt, sh, rm);
+    RingSlot *slot = ringSlot(mgmt, sh, rm, *cursor);
+    slot->frame = (int)(f - sh->frames);
+    slot->generation = f->generation;
+    slot->lastUsed = f->lastUsed;
+    *cursor = (*cursor + 1) % rm->perShard;
+}
 
-    Frame *curr = mgmtData->frames;
-    Frame *start = curr;
-    do {
-        Frame *temp = curr->next;
-        if (curr->data != NULL)
-            free(curr->data);
-        curr = temp;
-    } while (curr != start);
+// Take an unpinned frame off the strategy's victim lists, as selectVictim
+// does for the frame it returns.
+static void strategyClaimed(BM_BufferPool *const bm, BM_Shard *sh, Frame *f) {
+    if (inWindow(sh, f)) return;
+    if (bm->strategy == RS_LRU) listUnlink(sh, f);
+    else if (bm->strategy == RS_LRU_K) lrukRemove(sh, f);
+}
 
-    free(mgmtData->frames);  
-    closePageFile(mgmtData->fh);  
-    free(mgmtData->fh);           
-    free(mgmtData);          
-    free(bm->pageFile);  
-    bm->mgmtData = NULL;
+// Drop the page of unpinned frame f and make the frame the next one the
+// strategy reuses. If the page cannot be written back it stays.
+static RC emptyFrame(BM_BufferPool *const bm, BM_Shard *sh, Frame *f, BM_EvictReason reason) {
+    strategyClaimed(bm, sh, f);
+    RC rc = evictFrame(bm, sh, f, reason);
+    if (rc != RC_OK) {
+        strategyKept(bm, sh, f);
+        return rc;
+    }
+    nextGeneration(f);
+    strategyEmptied(bm, sh, f);
     return RC_OK;
 }
 
-
-RC forceFlushPool(BM_BufferPool *const bm) {
-    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
-    Frame *curr = mgmtData->frames;
-    Frame *start = curr;
-    do {
-        if (curr->isDirty && curr->fixCount == 0) {
-            writeBlock(curr->pageNum, mgmtData->fh, curr->data);
-            mgmtData->numWriteIO++;
-            curr->isDirty = false;
-        }
-        curr = curr->next;
-    } while (curr != start);
-    return RC_OK;
+// The frame for a ring miss: the next slot's frame, claimed, or NULL to
+// let the strategy choose.
+static Frame *ringVictim(BM_BufferPool *const bm, BM_Shard *sh, BM_RingMgmt *rm) {
+    BM_MgmtData *mgmt = (BM_MgmtData *)bm->mgmtData;
+    Frame *f = ringOwned(sh, ringSlot(mgmt, sh, rm, *ringCursor(mgmt, sh, rm)));
+    if (f != NULL) strategyClaimed(bm, sh, f);
+    return f;
 }
 
-RC markDirty(BM_BufferPool *const bm, BM_PageHandle *const page) {
-    Frame *curr = ((BM_MgmtData *)bm->mgmtData)->frames;
-    Frame *start = curr;
-    do {
-        if (curr->pageNum == page->pageNum) {
-            curr->isDirty = true;
-            return RC_OK;
+// A ring pin found f resident. Refresh the slot if the ring owns f; adopt
+// f if it was read ahead and not pinned yet, emptying the slot's old frame.
+static void ringHit(BM_BufferPool *const bm, BM_Shard *sh, BM_RingMgmt *rm, Frame *f) {
+    BM_MgmtData *mgmt = (BM_MgmtData *)bm->mgmtData;
+    int idx = (int)(f - sh->frames);
+    for (int n = 0; n < rm->perShard; n++) {
+        RingSlot *slot = ringSlot(mgmt, sh, rm, n);
+        if (slot->frame == idx && slot->generation == f->generation) {
+            slot->lastUsed = f->lastUsed;
+            return;
         }
-        curr = curr->next;
-    } while (curr != start);
-    return RC_ERROR;
+    }
+    if (!f->prefetched) return;
+
+    Frame *old = ringOwned(sh, ringSlot(mgmt, sh, rm, *ringCursor(mgmt, sh, rm)));
+    if (old != NULL && emptyFrame(bm, sh, old, BM_EVICT_RING) != RC_OK) return;
+    ringRecord(mgmt, sh, rm, f);
 }
 
-RC unpinPage(BM_BufferPool *const bm, BM_PageHandle *const page) {
-    Frame *curr = ((BM_MgmtData *)bm->mgmtData)->frames;
-    Frame *start = curr;
-    do {
-        if (curr->pageNum == page->pageNum) {
-            if (curr->fixCount > 0) curr->fixCount--;
-            return RC_OK;
-        }
-        curr = curr->next;
-    } while (curr != start);
-    return RC_ERROR;
+// Sequential read-ahead. Three pins of consecutive pages start a window of
+// MIN_READ_AHEAD pages past the last one; whenever the pins reach the middle
+// of what has been requested the next window, twice as large (up to
+// maxReadAhead), is queued with prefetchPages. A pin elsewhere halves the
+// window and restarts detection. Re-pinning the last page is neutral.
+static RC queuePrefetch(BM_BufferPool *const bm, PageNumber startKey, int count);
+
+static void readAheadObserve(BM_BufferPool *const bm, PageNumber pageNum) {
+    BM_MgmtData *mgmt = (BM_MgmtData *)bm->mgmtData;
+    PageNumber start = NO_PAGE;
+    int count = 0;
+
+    pthread_mutex_lock(&mgmt->raLatch);
+    if (pageNum == mgmt->raLast + 1) {
+        mgmt->raRun++;
+    } else if (pageNum != mgmt->raLast) {
+        mgmt->raRun = 0;
+        mgmt->raWindow /= 2;
+        mgmt->raEnd = 0;
+    }
+    mgmt->raLast = pageNum;
+
+    if (mgmt->raRun >= 2 && pageNum + mgmt->raWindow / 2 >= mgmt->raEnd) {
+        int window = mgmt->raWindow * 2;
+        if (window < MIN_READ_AHEAD) window = MIN_READ_AHEAD;
+        if (window > mgmt->maxReadAhead) window = mgmt->maxReadAhead;
+        mgmt->raWindow = window;
+        start = mgmt->raEnd > pageNum ? mgmt->raEnd : pageNum + 1;
+        count = pageNum + 1 + window - start;
+        mgmt->raEnd = start + count;
+    }
+    pthread_mutex_unlock(&mgmt->raLatch);
+
+    if (count > 0) queuePrefetch(bm, start, count);
 }
 
-RC forcePage(BM_BufferPool *const bm, BM_PageHandle *const page) {
-    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
-    Frame *curr = mgmtData->frames;
-    Frame *start = curr;
-    do {
-        if (curr->pageNum == page->pageNum) {
-            writeBlock(curr->pageNum, mgmtData->fh, curr->data);
-            mgmtData->numWriteIO++;
-            curr->isDirty = false;
-            return RC_OK;
-        }
-        curr = curr->next;
-    } while (curr != start);
-    return RC_ERROR;
+RC pinPage(BM_BufferPool *const bm, BM_PageHandle *const page, const PageNumber pageNum)
+    {
+    return pinPageWithRing(bm, page, pageNum, NULL);
 }
 
-RC pinPage(BM_BufferPool *const bm, BM_PageHandle *const page, const PageNumber pageNum) 
+// pinPage for a bulk reader: misses recycle the frames of ring (see the
+// access ring functions above). A NULL ring is a plain pinPage.
+RC pinPageWithRing(BM_BufferPool *const bm, BM_PageHandle *const page,
+                   const PageNumber pageNum, BM_AccessRing *const ring)
     {
+#ifdef BM_DEBUG
     printf(">> pinPage() called for pageNum = %d\n", pageNum); fflush(stdout);
+#endif
     BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
-    Frame *curr = mgmtData->frames;
-    Frame *start = curr;
-    do {
-        if (curr->pageNum == pageNum) {
-            curr->fixCount++;
-            curr->referenceBit = true;
-            curr->lastUsed = ++mgmtData->timestamp;
-            curr->history[curr->histIdx % K_VAL] = mgmtData->timestamp;
-            curr->histIdx++;
-            page->pageNum = pageNum;
-            page->data = curr->data;
-            return RC_OK;
-        }
-        curr = curr->next;
-    } while (curr != start);
+    if (mgmtData == NULL) return RC_FILE_HANDLE_NOT_INIT;
+    if (pageNum < 0) return RC_READ_NON_EXISTING_PAGE;
+    PageNumber key = pageKey(bm, pageNum);
+    if (key == NO_PAGE) return RC_READ_NON_EXISTING_PAGE;
+    BM_RingMgmt *rm = ring != NULL ? (BM_RingMgmt *)ring->mgmtData : NULL;
+    uint64_t start = mgmtData->pinLatency ? nowNanos() : 0;
+    if (mgmtData->readAhead) readAheadObserve(bm, key);
+
+    BM_Shard *sh = shardFor(mgmtData, key);
+    lockShardForPin(mgmtData, sh);
+    if (sh->numWindow > 0) sketchAdd(&sh->sketch, key);
+
+    int idx = lookupFrame(sh, key);
+    if (idx != EMPTY_SLOT) {
+        Frame *curr = &sh->frames[idx];
+        sh->numHits++;
+        fixFrame(sh, curr);
+        strategyHit(bm, sh, curr);
+        RC rc = waitLoaded(bm, sh, curr, key);
+        if (rc == RC_OK) fillHandle(mgmtData, page, curr);
+        if (rc == RC_OK && rm != NULL) ringHit(bm, sh, rm, curr);
+        if (rc == RC_OK && curr->prefetched) {
+            sh->numPrefetchHits++;
+            curr->prefetched = false;
+        }
+        pinTimed(mgmtData, sh, start);
+        unlockShard(mgmtData, sh);
+        if (rc == RC_OK) traceRecord(mgmtData, key, 0);
+        return rc;
+    }
 
+    sh->numMisses++;
     Frame *victim = NULL;
-    if (bm->strategy == RS_CLOCK) {
-        int passes = 0;
-        while (passes < 2 * bm->numPages) {
-            if (mgmtData->clockHand->fixCount == 0) {
-                if (!mgmtData->clockHand->referenceBit) {
-                    victim = mgmtData->clockHand;
-                    break;
-                } else {
-                    mgmtData->clockHand->referenceBit = false;
-                }
+    Frame *reuse = rm != NULL ? ringVictim(bm, sh, rm) : NULL;
+    RC rc = reuse != NULL ? loadInto(bm, sh, reuse, key, true, BM_EVICT_RING, &victim)
+                          : loadPage(bm, sh, key, true, BM_EVICT_MISS, &victim);
+    if (rc == RC_OK) fillHandle(mgmtData, page, victim);
+    if (rc == RC_OK && rm != NULL) ringRecord(mgmtData, sh, rm, victim);
+    pinTimed(mgmtData, sh, start);
+    unlockShard(mgmtData, sh);
+    if (rc == RC_OK) traceRecord(mgmtData, key, 0);
+    return rc;
+}
+
+// Batch pins. pinPages takes the shard latches one page at a time to fix
+// the pages that are resident and to map the others into victims as
+// loading, then reads the misses sorted by key, one readBlocks call per
+// run of consecutive pages of a file, and only then waits for pages other
+// threads were loading. Pages past the end of a file extend it, as in
+// pinPage, and are read one at a time.
+#define BATCH_MAX_RUN 64
+
+typedef struct BatchPin {
+    PageNumber key;
+    Frame *frame;
+    bool miss;
+    RC rc;
+} BatchPin;
+
+static int compareBatchKey(const void *a, const void *b) {
+    PageNumber x = (*(BatchPin *const *)a)->key, y = (*(BatchPin *const *)b)->key;
+    return (x > y) - (x < y);
+}
+
+// Read the misses run[0..n), consecutive pages of one file, with one call.
+static void readRun(BM_MgmtData *mgmt, BatchPin **run, int n) {
+    BM_FileMgmt *file = keyFile(mgmt, run[0]->key);
+    PageNumber first = keyPage(mgmt, run[0]->key);
+    SM_PageHandle buffers[BATCH_MAX_RUN];
+
+    lockIO(mgmt);
+    if (n > 1 && keyExists(mgmt, run[n - 1]->key)) {
+        for (int i = 0; i < n; i++) buffers[i] = run[i]->frame->data;
+        RC rc = readBlocks(first, n, &file->fh, buffers);
+        if (rc == RC_OK) file->numReadIO += n;
+        for (int i = 0; i < n; i++) run[i]->rc = rc;
+    } else {
+        for (int i = 0; i < n; i++)
+            run[i]->rc = readKey(mgmt, run[i]->key, run[i]->frame->data, true);
+    }
+    unlockIO(mgmt);
+}
+
+// Pin the n pages in pageNums into handles[0..n), as n pinPage calls
+// would, and return once all are resident. If any pin fails the pages
+// already pinned are unpinned again and its error is returned.
+RC pinPages(BM_BufferPool *const bm, BM_PageHandle *const handles,
+            const PageNumber *const pageNums, const int n) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    if (mgmtData == NULL) return RC_FILE_HANDLE_NOT_INIT;
+    if (n < 0) return RC_ERROR;
+    if (n == 0) return RC_OK;
+    for (int i = 0; i < n; i++) {
+        if (pageNums[i] < 0 || pageKey(bm, pageNums[i]) == NO_PAGE)
+            return RC_READ_NON_EXISTING_PAGE;
+    }
+    BatchPin *pins = malloc(sizeof(BatchPin) * n);
+    BatchPin **misses = malloc(sizeof(BatchPin *) * n);
+    if (pins == NULL || misses == NULL) {
+        free(pins);
+        free(misses);
+        return RC_NOMEM;
+    }
+
+    // fix the hits and map the misses
+    RC rc = RC_OK;
+    int mapped, numMisses = 0;
+    for (mapped = 0; mapped < n; mapped++) {
+        BatchPin *pin = &pins[mapped];
+        pin->key = pageKey(bm, pageNums[mapped]);
+        pin->rc = RC_OK;
+        BM_Shard *sh = shardFor(mgmtData, pin->key);
+        lockShard(mgmtData, sh);
+        if (sh->numWindow > 0) sketchAdd(&sh->sketch, pin->key);
+        int idx = lookupFrame(sh, pin->key);
+        if (idx != EMPTY_SLOT) {
+            pin->frame = &sh->frames[idx];
+            pin->miss = false;
+            sh->numHits++;
+            fixFrame(sh, pin->frame);
+            strategyHit(bm, sh, pin->frame);
+        } else {
+            pin->frame = sh->numWindow > 0 ? selectWindowVictim(bm, sh, pin->key, BM_EVICT_MISS)
+                                           : selectVictim(bm, sh, pin->key);
+            if (pin->frame == NULL) {
+                unlockShard(mgmtData, sh);
+                rc = RC_BUFFER_POOL_FULL;
+                break;
             }
-            mgmtData->clockHand = mgmtData->clockHand->next;
-            passes++;
-        }
-        if (victim != NULL) mgmtData->clockHand = victim->next;
-    } else if (bm->strategy == RS_FIFO) {
-        Frame *ptr = mgmtData->fifoPtr;
-        do {
-            if (ptr->fixCount == 0) {
-                victim = ptr;
+            rc = mapLoading(bm, sh, pin->frame, pin->key, BM_EVICT_MISS);
+            if (rc != RC_OK) {
+                unlockShard(mgmtData, sh);
                 break;
             }
-            ptr = ptr->next;
-        } while (ptr != mgmtData->fifoPtr);
-    } else if (bm->strategy == RS_LRU) {
-        Frame *ptr = mgmtData->frames;
-        int minTime = INT_MAX;
-        do {
-            if (ptr->fixCount == 0 && ptr->lastUsed < minTime) {
-                victim = ptr;
-                minTime = ptr->lastUsed;
+            pin->miss = true;
+            sh->numMisses++;
+            misses[numMisses++] = pin;
+        }
+        unlockShard(mgmtData, sh);
+    }
+
+    // read the misses in runs
+    qsort(misses, numMisses, sizeof(BatchPin *), compareBatchKey);
+    for (int i = 0; i < numMisses; ) {
+        int run = 1;
+        while (i + run < numMisses && run < BATCH_MAX_RUN &&
+               misses[i + run]->key == misses[i]->key + run &&
+               keyFile(mgmtData, misses[i + run]->key) == keyFile(mgmtData, misses[i]->key))
+            run++;
+        readRun(mgmtData, misses + i, run);
+        i += run;
+    }
+    for (int i = 0; i < numMisses; i++) {
+        BatchPin *pin = misses[i];
+        BM_Shard *sh = shardFor(mgmtData, pin->key);
+        lockShard(mgmtData, sh);
+        pin->rc = finishLoading(bm, sh, pin->frame, pin->key, pin->rc);
+        unlockShard(mgmtData, sh);
+    }
+
+    // the hits may still be loading for someone else
+    for (int i = 0; i < mapped; i++) {
+        BatchPin *pin = &pins[i];
+        BM_Shard *sh = shardFor(mgmtData, pin->key);
+        lockShard(mgmtData, sh);
+        if (!pin->miss) pin->rc = waitLoaded(bm, sh, pin->frame, pin->key);
+        if (pin->rc == RC_OK) {
+            fillHandle(mgmtData, &handles[i], pin->frame);
+            if (pin->frame->prefetched) {
+                sh->numPrefetchHits++;
+                pin->frame->prefetched = false;
             }
-            ptr = ptr->next;
-        } while (ptr != mgmtData->frames);
+        } else if (rc == RC_OK) {
+            rc = pin->rc;
+        }
+        unlockShard(mgmtData, sh);
+    }
+
+    for (int i = 0; i < mapped; i++) {
+        if (pins[i].rc != RC_OK) continue;
+        if (rc != RC_OK) unpinPage(bm, &handles[i]);
+        else traceRecord(mgmtData, pins[i].key, 0);
+    }
+    free(pins);
+    free(misses);
+    return rc;
+}
+
+// Set up a ring of about numFrames frames for one scan of bm. Every shard
+// gets at least one slot and at most half of its frames.
+RC initAccessRing(BM_BufferPool *const bm, BM_AccessRing *const ring, const int numFrames) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    if (mgmtData == NULL) return RC_FILE_HANDLE_NOT_INIT;
+    if (numFrames < 1) return RC_ERROR;
+
+    int perShard = (numFrames + mgmtData->numShards - 1) / mgmtData->numShards;
+    int maxPerShard = mgmtData->shards[mgmtData->numShards - 1].numFrames / 2;
+    if (perShard > maxPerShard) perShard = maxPerShard;
+    if (perShard < 1) perShard = 1;
+
+    BM_RingMgmt *rm = malloc(sizeof(BM_RingMgmt));
+    if (rm == NULL) return RC_NOMEM;
+    rm->perShard = perShard;
+    rm->cursor = calloc(mgmtData->numShards, sizeof(int));
+    rm->slots = malloc(sizeof(RingSlot) * perShard * mgmtData->numShards);
+    if (rm->cursor == NULL || rm->slots == NULL) {
+        free(rm->cursor);
+        free(rm->slots);
+        free(rm);
+        return RC_NOMEM;
+    }
+    for (int i = 0; i < perShard * mgmtData->numShards; i++)
+        rm->slots[i].frame = EMPTY_SLOT;
+
+    ring->numFrames = perShard * mgmtData->numShards;
+    ring->mgmtData = rm;
+    return RC_OK;
+}
+
+// Release the ring. Its frames stay in the pool with their pages.
+RC freeAccessRing(BM_AccessRing *const ring) {
+    BM_RingMgmt *rm = (BM_RingMgmt *)ring->mgmtData;
+    if (rm == NULL) return RC_FILE_HANDLE_NOT_INIT;
+    free(rm->cursor);
+    free(rm->slots);
+    free(rm);
+    ring->mgmtData = NULL;
+    return RC_OK;
+}
+
+// Resizing. Frames are only ever added or removed at the end of each shard,
+// so global frame ids stay dense: frame i of a pool of n frames lives in
+// shard i % S at local index i / S for every n up to maxPages. Growing
+// hands the new frames to the strategy as empty. Shrinking evicts the
+// unpinned frames being removed; a pinned one has its page moved into a
+// victim the strategy picks among the frames that stay, together with its
+// data buffer, so the caller's handle keeps pointing at the page. The moved
+// page takes the removed frame's place in the strategy's lists.
+
+static void shardUnlockAll(BM_MgmtData *mgmt) {
+    for (int s = mgmt->numShards - 1; s >= 0; s--) unlockShard(mgmt, &mgmt->shards[s]);
+}
+
+// A frame being read, or a pinner waiting for one, still expects the frame
+// to keep its page; such shards are left alone until they settle.
+static bool shardSettled(BM_Shard *sh) {
+    if (sh->numWaiters > 0) return false;
+    for (int i = 0; i < sh->numFrames; i++) {
+        if (sh->frames[i].loading) return false;
+    }
+    return true;
+}
+
+// Latch every shard in index order, each once it has settled.
+static void shardLockAll(BM_MgmtData *mgmt) {
+    for (int s = 0; s < mgmt->numShards; s++) {
+        BM_Shard *sh = &mgmt->shards[s];
+        lockShard(mgmt, sh);
+        while (mgmt->latching && !shardSettled(sh))
+            pthread_cond_wait(&sh->loadDone, &sh->latch);
+    }
+}
+
+static int shardPinned(BM_Shard *sh) {
+    int pinned = 0;
+    for (int i = 0; i < sh->numFrames; i++) {
+        if (fixCountAt(sh, i) != 0) pinned++;
+    }
+    return pinned;
+}
+
+// v takes f's place in a list linked through the frames.
+static void frameReplace(BM_Shard *sh, Frame *f, Frame *v, int *head, int *tail) {
+    int idx = (int)(v - sh->frames);
+    v->listPrev = f->listPrev;
+    v->listNext = f->listNext;
+    if (f->listPrev != EMPTY_SLOT) sh->frames[f->listPrev].listNext = idx;
+    else *head = idx;
+    if (f->listNext != EMPTY_SLOT) sh->frames[f->listNext].listPrev = idx;
+    else *tail = idx;
+}
+
+// Take f out of every replacement structure.
+static void strategyDetached(BM_BufferPool *const bm, BM_Shard *sh, Frame *f) {
+    if (bm->strategy == RS_LFU) {
+        int b = f->lfuBucket;
+        lfuRemove(sh, f);
+        lfuFreeIfEmpty(sh, b);
+    } else {
+        strategyClaimed(bm, sh, f);
+        listUnlink(sh, f);
+    }
+}
+
+// Register f, a frame just added to the shard, as empty.
+static void strategyAdded(BM_BufferPool *const bm, BM_Shard *sh, Frame *f) {
+    if (bm->strategy == RS_LRU) {
+        listPushBack(sh, &sh->lru, f);
+    } else if (bm->strategy == RS_ARC || bm->strategy == RS_2Q) {
+        listPushBack(sh, &sh->freeFrames, f);
+    } else if (bm->strategy == RS_LFU) {
+        int zero = sh->lfuFirst;
+        if (zero == EMPTY_SLOT || sh->lfuBuckets[zero].freq != 0)
+            zero = lfuNewBucket(sh, 0, EMPTY_SLOT);
+        lfuInsert(sh, zero, f, false);
     } else if (bm->strategy == RS_LRU_K) {
-        Frame *ptr = mgmtData->frames;
-        int minKth = INT_MAX;
-        do {
-            if (ptr->fixCount == 0 && ptr->histIdx >= K_VAL) {
-                int oldest = INT_MAX;
-                for (int i = 0; i < K_VAL; i++) {
-                    if (ptr->history[i] < oldest) {
-                        oldest = ptr->history[i];
-                    }
-                }
-                if (oldest < minKth) {
-                    victim = ptr;
-                    minKth = oldest;
-                }
-            }
-            ptr = ptr->next;
-        } while (ptr != mgmtData->frames);
+        lrukEmptied(sh, f);
+    }
+}
+
+// Move the page of f, a pinned frame being removed, into v, an evicted
+// frame that stays.
+static void relocateFrame(BM_BufferPool *const bm, BM_Shard *sh, Frame *f, Frame *v) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    strategyDetached(bm, sh, v);
+    if (bm->strategy == RS_LFU) {
+        LFUBucket *bucket = &sh->lfuBuckets[f->lfuBucket];
+        frameReplace(sh, f, v, &bucket->head, &bucket->tail);
+        v->lfuBucket = f->lfuBucket;
+    } else if (f->list != NULL) {
+        frameReplace(sh, f, v, &f->list->head, &f->list->tail);
+        v->list = f->list;
+        f->list = NULL;
+    }
+    if (bm->strategy == RS_LRU_K)
+        memcpy(v->history, f->history, sizeof(uint64_t) * sh->lrukK);
+
+    swapFrameData(v, f);
+    // unpinPage's latch-free path checks the generation before it touches
+    // the fix count, and falls back to the page table once it sees 0
+    nextGeneration(f);
+    removePageEntry(mgmtData, sh, f->pageNum);
+    setFramePage(v, f->pageNum);
+    v->isDirty = f->isDirty;
+    v->prefetched = f->prefetched;
+    v->lastUsed = f->lastUsed;
+    int fIdx = (int)(f - sh->frames);
+    int vIdx = (int)(v - sh->frames);
+    if (sh->refBits[fIdx / 64] & ((uint64_t)1 << (fIdx % 64)))
+        sh->refBits[vIdx / 64] |= (uint64_t)1 << (vIdx % 64);
+    setFramePage(f, NO_PAGE);
+    f->isDirty = false;
+    f->prefetched = false;
+    insertPageEntry(mgmtData, sh, vIdx);
+    nextGeneration(v);
+    int fixCount = __atomic_exchange_n(fixCountSlot(sh, f), 0, __ATOMIC_ACQ_REL);
+    __atomic_store_n(fixCountSlot(sh, v), fixCount, __ATOMIC_RELEASE);
+    if (fixCount == 0) strategyUnpinned(bm, sh, v);
+}
+
+// resizeBufferPool has written back every unpinned dirty page before, so
+// the evictions here drop clean pages only and cannot fail; pinned pages
+// move with their dirty flags.
+static void shrinkShard(BM_BufferPool *const bm, BM_Shard *sh, int numFrames) {
+    int old = sh->numFrames;
+    sh->arcDropVictim = false;
+    for (int i = numFrames; i < old; i++) {
+        Frame *f = &sh->frames[i];
+        if (fixCountOf(sh, f) != 0) continue;
+        strategyClaimed(bm, sh, f);
+        evictFrame(bm, sh, f, BM_EVICT_RESIZE);
+        strategyDetached(bm, sh, f);
+    }
 
-        if (victim == NULL) {
-            ptr = mgmtData->frames;
-            int minTime = INT_MAX;
-            do {
-                if (ptr->fixCount == 0 && ptr->lastUsed < minTime) {
-                    victim = ptr;
-                    minTime = ptr->lastUsed;
-                }
-                ptr = ptr->next;
-            } while (ptr != mgmtData->frames);
+    sh->numFrames = numFrames;
+    sh->clockHand %= numFrames;
+    sh->fifoPtr %= numFrames;
+    for (int i = numFrames; i < old; i++) {
+        Frame *f = &sh->frames[i];
+        if (f->pageNum == NO_PAGE) continue;
+        Frame *v = selectVictim(bm, sh, NO_PAGE);
+        while (v - sh->frames >= numFrames) {
+            // a frame being removed, unpinned since the first pass
+            evictFrame(bm, sh, v, BM_EVICT_RESIZE);
+            strategyDetached(bm, sh, v);
+            v = selectVictim(bm, sh, NO_PAGE);
+        }
+        if (f->pageNum == NO_PAGE) {
+            strategyKept(bm, sh, v);
+            continue;
         }
+        evictFrame(bm, sh, v, BM_EVICT_RESIZE);
+        relocateFrame(bm, sh, f, v);
     }
 
-    if (victim == NULL) return RC_BUFFER_POOL_FULL;
+    for (int i = numFrames; i < old; i++) {
+        Frame *f = &sh->frames[i];
+        sh->refBits[i / 64] &= ~((uint64_t)1 << (i % 64));
+        __atomic_store_n(fixCountSlot(sh, f), 0, __ATOMIC_RELAXED);
+        f->lastUsed = 0;
+        nextGeneration(f);
+        madvise(f->data, PAGE_SIZE, MADV_DONTNEED);
+    }
+}
+
+static void growShard(BM_BufferPool *const bm, BM_Shard *sh, int numFrames) {
+    int old = sh->numFrames;
+    sh->numFrames = numFrames;
+    for (int i = old; i < numFrames; i++)
+        strategyAdded(bm, sh, &sh->frames[i]);
+}
+
+// Size-dependent strategy parameters, after the shard changed size.
+static void strategyResized(BM_BufferPool *const bm, BM_Shard *sh) {
+    int c = sh->numFrames;
+    if (bm->strategy == RS_2Q) {
+        q2Sizes(sh);
+    } else if (bm->strategy == RS_ARC) {
+        GhostTable *g = &sh->arcGhosts;
+        if (sh->arcTarget > c) sh->arcTarget = c;
+        while (sh->arcT1.size + g->size[0] > c && g->size[0] > 0)
+            ghostRemove(g, g->tail[0]);
+        while (sh->arcT1.size + sh->arcT2.size + g->size[0] + g->size[1] > 2 * c &&
+               g->size[1] > 0)
+            ghostRemove(g, g->tail[1]);
+        ghostSetLimit(g, c + 1);
+    }
+}
+
+// Change the number of frames to newNumPages, at most the maxPages the pool
+// was created with. Fails with RC_BUFFER_POOL_FULL, changing nothing, if a
+// shard has more pinned pages than it would have frames. Shrinking first
+// writes back the dirty unpinned pages and fails with the write's error,
+// keeping the old size, if that fails. Pools with an admission window
+// cannot be resized.
+RC resizeBufferPool(BM_BufferPool *const bm, const int newNumPages) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    if (mgmtData == NULL) return RC_FILE_HANDLE_NOT_INIT;
+    if (newNumPages < mgmtData->numShards || newNumPages > mgmtData->maxPages)
+        return RC_ERROR;
+    if (mgmtData->shards[0].numWindow > 0) return RC_ERROR;
+
+    shardLockAll(mgmtData);
+
+    int numShards = mgmtData->numShards;
+    for (int s = 0; s < numShards; s++) {
+        int count = (newNumPages - s + numShards - 1) / numShards;
+        if (shardPinned(&mgmtData->shards[s]) > count) {
+            shardUnlockAll(mgmtData);
+            return RC_BUFFER_POOL_FULL;
+        }
+    }
+    if (newNumPages < mgmtData->numPages) {
+        RC rc = flushLatched(bm, true);
+        if (rc != RC_OK) {
+            shardUnlockAll(mgmtData);
+            return rc;
+        }
+    }
 
-    if (victim->isDirty) {
-        writeBlock(victim->pageNum, mgmtData->fh, victim->data);
-        mgmtData->numWriteIO++;
+    for (int s = 0; s < numShards; s++) {
+        BM_Shard *sh = &mgmtData->shards[s];
+        int count = (newNumPages - s + numShards - 1) / numShards;
+        if (count < sh->numFrames) shrinkShard(bm, sh, count);
+        else if (count > sh->numFrames) growShard(bm, sh, count);
+        strategyResized(bm, sh);
+        sh->writerCursor = 0;
     }
+    mgmtData->numPages = newNumPages;
+    bm->numPages = newNumPages;
+    if (mgmtData->writerRunning) setDirtyMarks(mgmtData);
+    shardUnlockAll(mgmtData);
+    return RC_OK;
+}
 
-    if (pageNum >= mgmtData->fh->totalNumPages)
- {
-        RC rc = ensureCapacity(pageNum + 1, mgmtData->fh);
-        if (rc != RC_OK) return rc;
+// Warm restart. With warmFile set, shutdownBufferPool writes the pool's
+// resident pages to it, their count on the first line and then one page
+// number per line from the least to the most recently used, and the next
+// initBufferPoolWithConfig reloads them before it returns. Pages are first
+// mapped through the strategy oldest first, so each strategy rebuilds its
+// recency order as if they had just been used in that order, and only then
+// read, sorted by page number, with one readBlocks call per run of
+// consecutive pages. Shards keep their own clocks, so with several shards
+// pages are ordered by how far through its shard's clock they were last
+// used. A missing list, or one that does not hold exactly as many complete
+// lines as its count says, just means a cold start. The shared pool has no
+// file of its own and ignores warmFile.
+#define WARM_MAX_RUN 256
+
+typedef struct WarmPage {
+    PageNumber pageNum;
+    Frame *frame;
+    double recency;
+} WarmPage;
+
+static int compareRecency(const void *a, const void *b) {
+    double x = ((const WarmPage *)a)->recency, y = ((const WarmPage *)b)->recency;
+    return (x > y) - (x < y);
+}
+
+static int comparePageNum(const void *a, const void *b) {
+    PageNumber x = ((const WarmPage *)a)->pageNum, y = ((const WarmPage *)b)->pageNum;
+    return (x > y) - (x < y);
+}
+
+static RC dumpPool(BM_BufferPool *const bm) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    WarmPage *pages = malloc(sizeof(WarmPage) * mgmtData->numPages);
+    if (pages == NULL) return RC_NOMEM;
+    int n = 0;
+    for (int s = 0; s < mgmtData->numShards; s++) {
+        BM_Shard *sh = &mgmtData->shards[s];
+        lockShard(mgmtData, sh);
+        for (int i = 0; i < sh->numFrames + sh->numWindow; i++) {
+            Frame *f = &sh->frames[i];
+            if (f->pageNum == NO_PAGE || f->loading) continue;
+            pages[n].pageNum = f->pageNum;
+            pages[n].recency = sh->timestamp > 0 ? (double)f->lastUsed / sh->timestamp : 0;
+            n++;
+        }
+        unlockShard(mgmtData, sh);
     }
+    qsort(pages, n, sizeof(WarmPage), compareRecency);
 
-    if (victim->data == NULL) {
-    printf(">>> victim->data is NULL!\n"); fflush(stdout);
-    return RC_ERROR;
+    // write a new list and rename it over the old one, so a crash midway
+    // leaves the previous list in place
+    size_t len = strlen(mgmtData->warmFile);
+    char *tmp = malloc(len + 5);
+    memcpy(tmp, mgmtData->warmFile, len);
+    strcpy(tmp + len, ".tmp");
+    RC rc = RC_WRITE_FAILED;
+    FILE *fp = fopen(tmp, "w");
+    if (fp != NULL) {
+        fprintf(fp, "%d\n", n);
+        for (int i = 0; i < n; i++) fprintf(fp, "%d\n", pages[i].pageNum);
+        if (fclose(fp) == 0 && rename(tmp, mgmtData->warmFile) == 0) rc = RC_OK;
     }
+    free(tmp);
+    free(pages);
+    return rc;
+}
 
-    RC rc = readBlock(pageNum, mgmtData->fh, victim->data);
-    if (rc != RC_OK) return rc;
+// Read the frames of pages[0..n), sorted by page number and all mapped to
+// consecutive pages, with one call. On failure the frames are emptied.
+static void warmRead(BM_BufferPool *const bm, WarmPage *pages, int n) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    SM_PageHandle buffers[WARM_MAX_RUN];
+    for (int i = 0; i < n; i++) buffers[i] = pages[i].frame->data;
 
-    victim->pageNum = pageNum;
-    victim->fixCount = 1;
-    victim->isDirty = false;
-    victim->referenceBit = true;
-    victim->lastUsed = ++mgmtData->timestamp;
-    victim->history[victim->histIdx % K_VAL] = mgmtData->timestamp;
-    victim->histIdx++;
+    lockIO(mgmtData);
+    RC rc = readBlocks(pages[0].pageNum, n, &mgmtData->files[0].fh, buffers);
+    if (rc == RC_OK) mgmtData->files[0].numReadIO += n;
+    unlockIO(mgmtData);
 
-    page->pageNum = pageNum;
-    page->data = victim->data;
-    mgmtData->numReadIO++;
+    for (int i = 0; i < n; i++) {
+        BM_Shard *sh = shardFor(mgmtData, pages[i].pageNum);
+        lockShard(mgmtData, sh);
+        if (rc == RC_OK) sh->numReadIO++;
+        else emptyFrame(bm, sh, pages[i].frame, BM_EVICT_RELOAD);
+        unlockShard(mgmtData, sh);
+    }
+}
+
+static void warmPool(BM_BufferPool *const bm) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    FILE *fp = fopen(mgmtData->warmFile, "r");
+    if (fp == NULL) return;
+    int count, read = 0, n = 0;
+    WarmPage *pages = NULL;
+    PageNumber pageNum;
+    char end;
+    // every line must be complete and the pages are distinct, so there
+    // cannot be more of them than the file has
+    if (fscanf(fp, "%d%c", &count, &end) == 2 && end == '\n' && count >= 0 &&
+        count <= mgmtData->files[0].fh.totalNumPages)
+        pages = malloc(sizeof(WarmPage) * (count > 0 ? count : 1));
+    while (pages != NULL && read < count && fscanf(fp, "%d%c", &pageNum, &end) == 2 &&
+           end == '\n') {
+        read++;
+        if (pageNum < 0 || pageNum >= mgmtData->files[0].fh.totalNumPages) continue;
+        pages[n++].pageNum = pageNum;
+    }
+    // a list that was cut short or has anything after it is not trusted
+    bool complete = pages != NULL && read == count && fgetc(fp) == EOF;
+    fclose(fp);
+    if (!complete) {
+        free(pages);
+        return;
+    }
+
+    // map the most recent numPages of them, oldest first; a shard that
+    // gets more than its share evicts its own older pages on the way
+    int first = n > mgmtData->numPages ? n - mgmtData->numPages : 0;
+    int mapped = 0;
+    for (int i = first; i < n; i++) {
+        BM_Shard *sh = shardFor(mgmtData, pages[i].pageNum);
+        lockShard(mgmtData, sh);
+        Frame *victim = NULL;
+        if (lookupFrame(sh, pages[i].pageNum) == EMPTY_SLOT)
+            victim = sh->numWindow > 0
+                         ? selectWindowVictim(bm, sh, pages[i].pageNum, BM_EVICT_RELOAD)
+                         : selectVictim(bm, sh, pages[i].pageNum);
+        if (victim != NULL && evictFrame(bm, sh, victim, BM_EVICT_RELOAD) != RC_OK) {
+            strategyKept(bm, sh, victim);
+            victim = NULL;
+        }
+        if (victim != NULL) {
+            setFramePage(victim, pages[i].pageNum);
+            nextGeneration(victim);
+            insertPageEntry(mgmtData, sh, (int)(victim - sh->frames));
+            strategyLoaded(bm, sh, victim);
+            strategyUnpinned(bm, sh, victim);
+            pages[mapped].pageNum = pages[i].pageNum;
+            pages[mapped].frame = victim;
+            mapped++;
+        }
+        unlockShard(mgmtData, sh);
+    }
+
+    // drop pages whose frame a later one took, then read the rest in order
+    int kept = 0;
+    for (int i = 0; i < mapped; i++)
+        if (pages[i].frame->pageNum == pages[i].pageNum) pages[kept++] = pages[i];
+    qsort(pages, kept, sizeof(WarmPage), comparePageNum);
+    for (int i = 0; i < kept;) {
+        int run = 1;
+        while (i + run < kept && run < WARM_MAX_RUN &&
+               pages[i + run].pageNum == pages[i].pageNum + run)
+            run++;
+        warmRead(bm, pages + i, run);
+        i += run;
+    }
+    free(pages);
+}
+
+// Shared pool. initSharedBufferPool creates one pool for the whole process
+// with a table of BM_MAX_FILES file slots. attachBufferPool opens a file in
+// a free slot, or shares the slot of a file attached under the same name,
+// and fills in a BM_BufferPool that the usual calls take. All files compete
+// for the same frames under one strategy, so a busy table takes frames from
+// idle ones, and getNumResidentPages, getNumReadIO and getNumWriteIO report
+// each file's share. sharedLatch orders attaching and detaching with
+// creating and destroying the pool.
+
+RC initSharedBufferPool(const int numPages, ReplacementStrategy strategy,
+                        void *stratData, const BM_PoolConfig *config) {
+    if (numPages <= 0) return RC_ERROR;
+    pthread_mutex_lock(&sharedLatch);
+    RC rc = RC_ERROR;
+    if (sharedPool.mgmtData == NULL) {
+        sharedPool.pageFile = NULL;
+        sharedPool.fileId = -1;
+        rc = createPool(&sharedPool, numPages, strategy, stratData, config, BM_MAX_FILES);
+    }
+    pthread_mutex_unlock(&sharedLatch);
+    return rc;
+}
+
+// Files still attached are closed; their pools must not be used afterwards.
+RC shutdownSharedBufferPool(void) {
+    pthread_mutex_lock(&sharedLatch);
+    RC rc = sharedPool.mgmtData != NULL ? shutdownBufferPool(&sharedPool)
+                                        : RC_FILE_HANDLE_NOT_INIT;
+    pthread_mutex_unlock(&sharedLatch);
+    return rc;
+}
+
+// The shared pool's own handle, for resizeBufferPool and pool-wide
+// statistics, or NULL if there is none.
+BM_BufferPool *getSharedBufferPool(void) {
+    return sharedPool.mgmtData != NULL ? &sharedPool : NULL;
+}
+
+RC attachBufferPool(BM_BufferPool *const bm, const char *const pageFileName) {
+    pthread_mutex_lock(&sharedLatch);
+    BM_MgmtData *mgmt = (BM_MgmtData *)sharedPool.mgmtData;
+    if (mgmt == NULL) {
+        pthread_mutex_unlock(&sharedLatch);
+        return RC_FILE_HANDLE_NOT_INIT;
+    }
+
+    int slot = -1;
+    int freeSlot = -1;
+    for (int i = 0; i < BM_MAX_FILES && slot < 0; i++) {
+        BM_FileMgmt *file = &mgmt->files[i];
+        if (file->refCount > 0 && strcmp(file->name, pageFileName) == 0) slot = i;
+        else if (file->refCount == 0 && freeSlot < 0) freeSlot = i;
+    }
+
+    RC rc = RC_OK;
+    if (slot >= 0) {
+        lockIO(mgmt);
+        mgmt->files[slot].refCount++;
+        unlockIO(mgmt);
+    } else if (freeSlot < 0) {
+        rc = RC_ERROR;
+    } else {
+        SM_FileHandle fh;
+        rc = openPageFile((char *)pageFileName, &fh);
+        if (rc == RC_OK) {
+            BM_FileMgmt *file = &mgmt->files[freeSlot];
+            lockIO(mgmt);
+            file->fh = fh;
+            file->name = strdup(pageFileName);
+            file->closing = false;
+            file->numReadIO = 0;
+            file->numWriteIO = 0;
+            file->numWritesSaved = 0;
+            file->refCount = 1;
+            unlockIO(mgmt);
+            slot = freeSlot;
+        }
+    }
+    if (rc == RC_OK) {
+        bm->pageFile = strdup(pageFileName);
+        bm->numPages = mgmt->numPages;
+        bm->strategy = sharedPool.strategy;
+        bm->mgmtData = mgmt;
+        bm->fileId = slot;
+    }
+    pthread_mutex_unlock(&sharedLatch);
+    return rc;
+}
+
+// The last attachment of a file writes back its dirty pages and empties the
+// frames holding them, pinned or not, so that the slot can take another
+// file. If a write fails the file stays attached, with its pages, and the
+// error is returned. Reads of the file are refused once its pages are
+// written, which keeps a queued prefetch from loading one of them again.
+static RC detachBufferPool(BM_BufferPool *const bm) {
+    BM_MgmtData *mgmt = (BM_MgmtData *)bm->mgmtData;
+    BM_FileMgmt *file = &mgmt->files[bm->fileId];
+
+    pthread_mutex_lock(&sharedLatch);
+    if (file->refCount > 1) {
+        lockIO(mgmt);
+        file->refCount--;
+        unlockIO(mgmt);
+    } else {
+        shardLockAll(mgmt);
+        RC rc = RC_OK;
+        for (int s = 0; s < mgmt->numShards && rc == RC_OK; s++) {
+            BM_Shard *sh = &mgmt->shards[s];
+            for (int i = 0; i < sh->numFrames + sh->numWindow && rc == RC_OK; i++) {
+                Frame *f = &sh->frames[i];
+                if (f->isDirty && f->pageNum != NO_PAGE && frameOfFile(bm, f))
+                    rc = writeFrame(mgmt, sh, f);
+            }
+        }
+        if (rc != RC_OK) {
+            shardUnlockAll(mgmt);
+            pthread_mutex_unlock(&sharedLatch);
+            return rc;
+        }
+        lockIO(mgmt);
+        file->closing = true;
+        unlockIO(mgmt);
+        for (int s = 0; s < mgmt->numShards; s++) {
+            BM_Shard *sh = &mgmt->shards[s];
+            for (int i = 0; i < sh->numFrames + sh->numWindow; i++) {
+                Frame *f = &sh->frames[i];
+                if (f->pageNum == NO_PAGE || !frameOfFile(bm, f)) continue;
+                __atomic_store_n(fixCountSlot(sh, f), 0, __ATOMIC_RELAXED);
+                emptyFrame(bm, sh, f, BM_EVICT_DETACH);
+            }
+        }
+        shardUnlockAll(mgmt);
+
+        lockIO(mgmt);
+        closePageFile(&file->fh);
+        free(file->name);
+        file->refCount = 0;
+        file->closing = false;
+        unlockIO(mgmt);
+    }
+    pthread_mutex_unlock(&sharedLatch);
 
-    if (bm->strategy == RS_FIFO) {
-        mgmtData->fifoPtr = victim->next;
+    free(bm->pageFile);
+    bm->mgmtData = NULL;
+    return RC_OK;
+}
+
+// Prefetching. Requested pages are queued for a prefetcher thread that
+// loads them into unpinned frames through loadPage, so a caller that pins
+// them later finds them resident (or waits for the read already under way
+// instead of issuing its own). The thread is started by the first call; a
+// pool created without latching switches latching on at that point, which
+// is safe because until then only the calling thread used it.
+// A queued page that a sequential scan has already pinned past. On a busy
+// machine the prefetcher can fall behind the scan it reads ahead for, and
+// loading such pages would only evict others.
+static bool behindReadAhead(BM_MgmtData *mgmt, PageNumber pageNum) {
+    pthread_mutex_lock(&mgmt->raLatch);
+    bool behind = mgmt->raRun >= 2 && pageNum <= mgmt->raLast;
+    pthread_mutex_unlock(&mgmt->raLatch);
+    return behind;
+}
+
+static void prefetchOne(BM_BufferPool *const bm, PageNumber pageNum) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    lockIO(mgmtData);
+    bool exists = keyExists(mgmtData, pageNum);
+    unlockIO(mgmtData);
+    if (!exists) return;
+
+    if (mgmtData->readAhead && behindReadAhead(mgmtData, pageNum)) return;
+
+    BM_Shard *sh = shardFor(mgmtData, pageNum);
+    lockShard(mgmtData, sh);
+    if (lookupFrame(sh, pageNum) == EMPTY_SLOT) {
+        Frame *f = NULL;
+        if (loadPage(bm, sh, pageNum, false, BM_EVICT_PREFETCH, &f) == RC_OK) {
+            sh->numPrefetched++;
+            f->prefetched = true;
+            if (unfixFrame(sh, f) == 0) strategyUnpinned(bm, sh, f);
+        }
+    }
+    unlockShard(mgmtData, sh);
+}
+
+static void *prefetcher(void *arg) {
+    BM_BufferPool *bm = (BM_BufferPool *)arg;
+    BM_MgmtData *mgmt = (BM_MgmtData *)bm->mgmtData;
+    pthread_mutex_lock(&mgmt->prefetchLatch);
+    while (!mgmt->prefetchStop) {
+        if (mgmt->prefetchCount == 0) {
+            pthread_cond_wait(&mgmt->prefetchWake, &mgmt->prefetchLatch);
+            continue;
+        }
+        PageNumber pageNum = mgmt->prefetchQueue[mgmt->prefetchHead];
+        mgmt->prefetchHead = (mgmt->prefetchHead + 1) % mgmt->maxPages;
+        mgmt->prefetchCount--;
+        pthread_mutex_unlock(&mgmt->prefetchLatch);
+        prefetchOne(bm, pageNum);
+        pthread_mutex_lock(&mgmt->prefetchLatch);
     }
+    pthread_mutex_unlock(&mgmt->prefetchLatch);
+    return NULL;
+}
+
+static void stopPrefetcher(BM_MgmtData *mgmt) {
+    if (!mgmt->prefetcherRunning) return;
+    pthread_mutex_lock(&mgmt->prefetchLatch);
+    mgmt->prefetchStop = true;
+    pthread_cond_signal(&mgmt->prefetchWake);
+    pthread_mutex_unlock(&mgmt->prefetchLatch);
+    pthread_join(mgmt->prefetcher, NULL);
+    mgmt->prefetcherRunning = false;
+}
+
+// The prefetcher works on keys and outlives the handles of attached files,
+// so in the shared pool it runs on the pool's own handle.
+static RC queuePrefetch(BM_BufferPool *const bm, PageNumber startKey, int count) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    BM_BufferPool *owner = mgmtData->shared ? &sharedPool : bm;
 
+    pthread_mutex_lock(&mgmtData->prefetchLatch);
+    if (!mgmtData->prefetcherRunning) {
+        mgmtData->prefetchQueue = malloc(sizeof(PageNumber) * mgmtData->maxPages);
+        if (mgmtData->prefetchQueue == NULL) {
+            pthread_mutex_unlock(&mgmtData->prefetchLatch);
+            return RC_NOMEM;
+        }
+        mgmtData->latching = true;
+        mgmtData->prefetchStop = false;
+        if (pthread_create(&mgmtData->prefetcher, NULL, prefetcher, owner) != 0) {
+            pthread_mutex_unlock(&mgmtData->prefetchLatch);
+            return RC_ERROR;
+        }
+        mgmtData->prefetcherRunning = true;
+    }
+    for (int i = 0; i < count && mgmtData->prefetchCount < mgmtData->maxPages; i++) {
+        int tail = (mgmtData->prefetchHead + mgmtData->prefetchCount) % mgmtData->maxPages;
+        mgmtData->prefetchQueue[tail] = startKey + i;
+        mgmtData->prefetchCount++;
+    }
+    pthread_cond_signal(&mgmtData->prefetchWake);
+    pthread_mutex_unlock(&mgmtData->prefetchLatch);
     return RC_OK;
 }
 
+// Queue pages startPage .. startPage + count - 1 for loading and return
+// without waiting. Pages already resident, past the end of the file or that
+// do not fit in the queue (one pool's worth of pages) are skipped.
+RC prefetchPages(BM_BufferPool *const bm, const PageNumber startPage, const int count) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    if (mgmtData == NULL) return RC_FILE_HANDLE_NOT_INIT;
+    if (startPage < 0 || count < 0) return RC_READ_NON_EXISTING_PAGE;
+    PageNumber startKey = pageKey(bm, startPage);
+    if (startKey == NO_PAGE) return RC_READ_NON_EXISTING_PAGE;
+    int n = count;
+    if (mgmtData->shared && startPage + (long)n > 1 << BM_FILE_PAGE_BITS)
+        n = (1 << BM_FILE_PAGE_BITS) - startPage;
+    return queuePrefetch(bm, startKey, n);
+}
+
+// The frame getters go by the pool's current size, not bm->numPages: a
+// handle attached to the shared pool keeps the size it saw at attach time
+// while another handle may resize the pool. The size is read with every
+// shard latched, which holds off resizeBufferPool, and stored back into
+// bm->numPages for the caller to iterate by. The arrays have room for
+// maxPages entries, so one returned before a resize stays long enough for
+// the size another returns after it.
+static int latchFrameCount(BM_BufferPool *const bm) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    for (int s = 0; s < mgmtData->numShards; s++) lockShard(mgmtData, &mgmtData->shards[s]);
+    bm->numPages = mgmtData->numPages;
+    return mgmtData->numPages;
+}
+
+// A file attached to the shared pool sees its own pages in the frames
+// that hold them and empty frames elsewhere; the shared pool's handle
+// sees the keys of all files.
 int *getFrameContents(BM_BufferPool *const bm) {
-    int *contents = (int *)malloc(sizeof(int) * bm->numPages);
-    Frame *curr = ((BM_MgmtData *)bm->mgmtData)->frames;
-    for (int i = 0; i < bm->numPages; i++) {
-        contents[i] = curr->pageNum;
-        curr = curr->next;
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    int *contents = (int *)malloc(sizeof(int) * mgmtData->maxPages);
+    int n = latchFrameCount(bm);
+    for (int i = 0; i < mgmtData->maxPages; i++) {
+        Frame *f = frameAt(mgmtData, i);
+        contents[i] = i >= n || !frameOfFile(bm, f) ? NO_PAGE
+                    : bm->fileId < 0 ? f->pageNum : keyPage(mgmtData, f->pageNum);
     }
+    shardUnlockAll(mgmtData);
     return contents;
 }
 
 bool *getDirtyFlags(BM_BufferPool *const bm) {
-    bool *flags = (bool *)malloc(sizeof(bool) * bm->numPages);
-    Frame *curr = ((BM_MgmtData *)bm->mgmtData)->frames;
-    for (int i = 0; i < bm->numPages; i++) {
-        flags[i] = curr->isDirty;
-        curr = curr->next;
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    bool *flags = (bool *)malloc(sizeof(bool) * mgmtData->maxPages);
+    int n = latchFrameCount(bm);
+    for (int i = 0; i < mgmtData->maxPages; i++) {
+        Frame *f = frameAt(mgmtData, i);
+        flags[i] = i < n && frameOfFile(bm, f) && f->isDirty;
     }
+    shardUnlockAll(mgmtData);
     return flags;
 }
 
 int *getFixCounts(BM_BufferPool *const bm) {
-    int *counts = (int *)malloc(sizeof(int) * bm->numPages);
-    Frame *curr = ((BM_MgmtData *)bm->mgmtData)->frames;
-    for (int i = 0; i < bm->numPages; i++) {
-        counts[i] = curr->fixCount;
-        curr = curr->next;
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    int *counts = (int *)malloc(sizeof(int) * mgmtData->maxPages);
+    int n = latchFrameCount(bm);
+    for (int i = 0; i < mgmtData->maxPages; i++) {
+        BM_Shard *sh = &mgmtData->shards[i % mgmtData->numShards];
+        Frame *f = &sh->frames[i / mgmtData->numShards];
+        counts[i] = i < n && frameOfFile(bm, f) ? fixCountOf(sh, f) : 0;
     }
+    shardUnlockAll(mgmtData);
     return counts;
 }
 
+// I/O of bm's file, or of the whole pool for the shared pool's handle.
 int getNumReadIO(BM_BufferPool *const bm) {
-    return ((BM_MgmtData *)bm->mgmtData)->numReadIO;
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    if (mgmtData->shared && bm->fileId >= 0) return mgmtData->files[bm->fileId].numReadIO;
+    int total = 0;
+    for (int s = 0; s < mgmtData->numShards; s++)
+        total += mgmtData->shards[s].numReadIO;
+    return total;
+}
+
+// Page writes that forceFlushPool folded into the write of the page before.
+int getNumWritesSaved(BM_BufferPool *const bm) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    if (mgmtData->shared && bm->fileId >= 0) return mgmtData->files[bm->fileId].numWritesSaved;
+    return mgmtData->numWritesSaved;
 }
 
 int getNumWriteIO(BM_BufferPool *const bm) {
-    return ((BM_MgmtData *)bm->mgmtData)->numWriteIO;
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    if (mgmtData->shared && bm->fileId >= 0) return mgmtData->files[bm->fileId].numWriteIO;
+    int total = 0;
+    for (int s = 0; s < mgmtData->numShards; s++)
+        total += mgmtData->shards[s].numWriteIO;
+    return total;
+}
+
+// Frames holding a page of bm's file: its share of a shared pool.
+int getNumResidentPages(BM_BufferPool *const bm) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    if (mgmtData->shared && bm->fileId >= 0)
+        return __atomic_load_n(&mgmtData->files[bm->fileId].numResident, __ATOMIC_RELAXED);
+    int total = 0;
+    for (int i = 0; i < (mgmtData->shared ? BM_MAX_FILES : 1); i++)
+        total += __atomic_load_n(&mgmtData->files[i].numResident, __ATOMIC_RELAXED);
+    return total;
+}
+
+int getAdmissionSketchBytes(BM_BufferPool *const bm) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    int total = 0;
+    for (int s = 0; s < mgmtData->numShards; s++)
+        total += sketchBytes(&mgmtData->shards[s].sketch);
+    return total;
+}
+
+int getNumAdmissionRejects(BM_BufferPool *const bm) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    int total = 0;
+    for (int s = 0; s < mgmtData->numShards; s++)
+        total += mgmtData->shards[s].numAdmissionRejects;
+    return total;
+}
+
+int getReadAheadWindow(BM_BufferPool *const bm) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    return mgmtData->readAhead ? mgmtData->raWindow : 0;
+}
+
+int getNumPrefetchHits(BM_BufferPool *const bm) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    int total = 0;
+    for (int s = 0; s < mgmtData->numShards; s++)
+        total += mgmtData->shards[s].numPrefetchHits;
+    return total;
+}
+
+int getNumPrefetchWasted(BM_BufferPool *const bm) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    int total = 0;
+    for (int s = 0; s < mgmtData->numShards; s++)
+        total += mgmtData->shards[s].numPrefetchWasted;
+    return total;
+}
+
+// Sums the shards' counters, each shard under its latch, and walks the
+// frames for the page counts, so the snapshot is safe to take while other
+// threads use the pool; nothing is allocated.
+RC getPoolStats(BM_BufferPool *const bm, BM_PoolStats *const stats) {
+    BM_MgmtData *mgmtData = (BM_MgmtData *)bm->mgmtData;
+    if (mgmtData == NULL) return RC_FILE_HANDLE_NOT_INIT;
+
+    memset(stats, 0, sizeof(BM_PoolStats));
+    stats->numPages = mgmtData->numPages;
+    for (int s = 0; s < mgmtData->numShards; s++) {
+        BM_Shard *sh = &mgmtData->shards[s];
+        lockShard(mgmtData, sh);
+        for (int i = 0; i < sh->numFrames + sh->numWindow; i++) {
+            Frame *f = &sh->frames[i];
+            if (f->pageNum == NO_PAGE || !frameOfFile(bm, f)) continue;
+            stats->residentPages++;
+            if (f->isDirty) stats->dirtyPages++;
+            if (fixCountOf(sh, f) > 0) stats->pinnedPages++;
+        }
+        stats->hits += sh->numHits;
+        stats->misses += sh->numMisses;
+        for (int r = 0; r < BM_NUM_EVICT_REASONS; r++)
+            stats->evictions[r] += sh->numEvictions[r];
+        stats->dirtyEvictions += sh->numDirtyEvictions;
+        stats->pinWaits += sh->numPinWaits;
+        stats->pinWaitNanos += sh->pinWaitNanos;
+        for (int b = 0; b < BM_LATENCY_BUCKETS; b++)
+            stats->pinLatency[b] += sh->pinLatency[b];
+        stats->readIO += sh->numReadIO;
+        stats->writeIO += sh->numWriteIO;
+        stats->writeErrors += sh->numWriteErrors;
+        stats->prefetchHits += sh->numPrefetchHits;
+        stats->prefetchWasted += sh->numPrefetchWasted;
+        stats->admissionRejects += sh->numAdmissionRejects;
+        unlockShard(mgmtData, sh);
+    }
+    lockIO(mgmtData);
+    stats->writesSaved = mgmtData->numWritesSaved;
+    if (mgmtData->shared && bm->fileId >= 0) {
+        BM_FileMgmt *file = &mgmtData->files[bm->fileId];
+        stats->readIO = file->numReadIO;
+        stats->writeIO = file->numWriteIO;
+        stats->writesSaved = file->numWritesSaved;
+    }
+    unlockIO(mgmtData);
+    return RC_OK;
 }
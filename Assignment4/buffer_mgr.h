@@ -11,13 +11,19 @@
 
 #include "storage_mgr.h"
 
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
 // Replacement Strategies
 typedef enum ReplacementStrategy {
 	RS_FIFO = 0,
 	RS_LRU = 1,
 	RS_CLOCK = 2,
 	RS_LFU = 3,
-	RS_LRU_K = 4
+	RS_LRU_K = 4,
+	RS_ARC = 5,
+	RS_2Q = 6
 } ReplacementStrategy;
 
 // Data Types and Structures
@@ -30,13 +36,126 @@ typedef struct BM_BufferPool {
 	ReplacementStrategy strategy;
 	void *mgmtData; // use this one to store the bookkeeping info your buffer
 	// manager needs for a buffer pool
+	int fileId;     // the file's slot in a shared pool, see attachBufferPool
 } BM_BufferPool;
 
+// The shared pool keys pages by file slot and page number, so an attached
+// file may have up to 2^BM_FILE_PAGE_BITS pages.
+#define BM_MAX_FILES 256
+#define BM_FILE_PAGE_BITS 23
+
+// Page latches taken by pinPageLatched on top of the pin.
+typedef enum BM_LatchMode {
+	BM_LATCH_NONE = 0,
+	BM_LATCH_SHARED = 1,    // many holders, the page does not change meanwhile
+	BM_LATCH_EXCLUSIVE = 2  // one holder, who may modify the page
+} BM_LatchMode;
+
 typedef struct BM_PageHandle {
 	PageNumber pageNum;
 	char *data;
+	int frame;             // opaque frame reference filled in by pinPage
+	unsigned int frameGen; // generation of that frame, detects stale handles
+	BM_LatchMode latch;    // latch held through this handle, released by unpinPage
 } BM_PageHandle;
 
+// Optional pool settings for initBufferPoolWithConfig. A zeroed struct (or
+// NULL) gives the single-threaded pool that initBufferPool creates.
+typedef struct BM_PoolConfig {
+	bool concurrent; // latch the pool so several threads may share it
+	int numShards;   // frame partitions; 0 = one per online CPU when concurrent
+	bool admission;  // TinyLFU admission filter in front of the strategy
+	int windowPercent; // admission window share of the pool; 0 = 1%
+	bool backgroundWriter; // clean dirty frames from a writer thread (implies latching)
+	int dirtyWatermark;    // % of frames dirty that wakes the writer; 0 = 10%
+	bool readAhead;        // detect sequential pins and prefetch ahead of them
+	int maxReadAhead;      // largest read-ahead window in pages; 0 = 32
+	int maxPages;          // frames reserved for resizeBufferPool; 0 = numPages
+	const char *warmFile;  // resident pages saved here at shutdown and reloaded at init
+	bool pinLatency;       // time every pinPage for BM_PoolStats.pinLatency
+	const char *traceFile; // record pinPage/unpinPage calls here, see BM_TRACE_MAGIC
+} BM_PoolConfig;
+
+// A trace file starts with the 8 bytes of BM_TRACE_MAGIC, followed by one
+// 4-byte little-endian record per successful pinPage or unpinPage call:
+// the page number (for the shared pool the key, file slot included)
+// shifted left by one, with the low bit set for unpinPage. Calls from
+// several threads are recorded in the order they took the trace latch.
+// simulate_buffer_mgr replays traces against every strategy.
+#define BM_TRACE_MAGIC "BMTRACE1"
+#define BM_TRACE_UNPIN 1
+
+// Strategy parameters for RS_LFU, passed as stratData (NULL = no aging).
+typedef struct BM_LFUParams {
+	int decayInterval; // halve all reference counts every decayInterval pins (0 = never)
+} BM_LFUParams;
+
+// Strategy parameters for RS_LRU_K, passed as stratData. Zero fields (or
+// NULL) take the defaults: K = K_VAL, a correlated reference period of one
+// shard's worth of pins and a retained history of one shard's worth of
+// frames. Periods are measured in pins on the page's shard.
+typedef struct BM_LRUKParams {
+	int k;                // references tracked per page
+	int correlatedPeriod; // re-references closer than this count as one
+	int retainedHistory;  // evicted pages whose history is kept
+} BM_LRUKParams;
+
+// Strategy parameters for RS_2Q, passed as stratData. Sizes are percentages
+// of the pool; zero fields (or NULL) take the defaults of 25% for A1in and
+// 50% for A1out.
+typedef struct BM_2QParams {
+	int inPercent;  // frames for A1in, the FIFO of pages referenced once
+	int outPercent; // evicted A1in pages remembered in the A1out ghost queue
+} BM_2QParams;
+
+// A small private set of frames for one bulk reader, such as a table
+// scan. Misses pinned through the ring recycle the frames the ring loaded
+// itself instead of evicting pages the rest of the pool is using. A ring
+// belongs to one scan and must not be shared between threads.
+typedef struct BM_AccessRing {
+	int numFrames; // frames the ring recycles
+	void *mgmtData;
+} BM_AccessRing;
+
+// Why a page left the pool, the index into BM_PoolStats.evictions.
+typedef enum BM_EvictReason {
+	BM_EVICT_MISS = 0,     // victim for a page being pinned
+	BM_EVICT_PREFETCH = 1, // victim for a page being read ahead
+	BM_EVICT_RING = 2,     // recycled by an access ring
+	BM_EVICT_RESIZE = 3,   // its frame was removed by resizeBufferPool
+	BM_EVICT_DETACH = 4,   // its file was detached from the shared pool
+	BM_EVICT_RELOAD = 5,   // displaced while reloading a warm restart list
+	BM_NUM_EVICT_REASONS = 6
+} BM_EvictReason;
+
+// pinLatency[i] counts pins that took 2^i to 2^(i+1) - 1 ns; the last
+// bucket also holds everything slower.
+#define BM_LATENCY_BUCKETS 32
+
+// A snapshot of a pool's counters, filled in by getPoolStats. Counters run
+// from the pool's creation. For a file attached to the shared pool the
+// page counts and I/O are the file's, everything else the whole pool's.
+typedef struct BM_PoolStats {
+	int numPages;          // frames
+	int residentPages;     // frames holding a page
+	int dirtyPages;
+	int pinnedPages;
+	uint64_t hits;         // pins that found their page resident
+	uint64_t misses;       // pins that had to read it
+	uint64_t evictions[BM_NUM_EVICT_REASONS];
+	uint64_t dirtyEvictions; // evicted pages that had to be written first
+	uint64_t pinWaits;     // times a pin blocked on a latch or another pin's read
+	uint64_t pinWaitNanos; // time spent blocked
+	uint64_t pinLatency[BM_LATENCY_BUCKETS]; // all zero unless config.pinLatency
+	int readIO;
+	int writeIO;
+	int writesSaved;
+	int writeErrors;       // background writes that failed, their pages left dirty
+	int prefetchHits;
+	int prefetchWasted;
+	int admissionRejects;
+} BM_PoolStats;
+
 // convenience macros
 #define MAKE_POOL()					\
 		((BM_BufferPool *) malloc (sizeof(BM_BufferPool)))
@@ -48,8 +167,20 @@ typedef struct BM_PageHandle {
 RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName, 
 		const int numPages, ReplacementStrategy strategy,
 		void *stratData);
+RC initBufferPoolWithConfig(BM_BufferPool *const bm, const char *const pageFileName,
+		const int numPages, ReplacementStrategy strategy,
+		void *stratData, const BM_PoolConfig *config);
 RC shutdownBufferPool(BM_BufferPool *const bm);
 RC forceFlushPool(BM_BufferPool *const bm);
+RC resizeBufferPool(BM_BufferPool *const bm, const int newNumPages);
+
+// Process-wide shared pool: one memory budget for every file attached to
+// it. shutdownBufferPool on an attached pool detaches the file.
+RC initSharedBufferPool(const int numPages, ReplacementStrategy strategy,
+		void *stratData, const BM_PoolConfig *config);
+RC shutdownSharedBufferPool(void);
+BM_BufferPool *getSharedBufferPool(void);
+RC attachBufferPool(BM_BufferPool *const bm, const char *const pageFileName);
 
 // Buffer Manager Interface Access Pages
 RC markDirty (BM_BufferPool *const bm, BM_PageHandle *const page);
@@ -57,6 +188,28 @@ RC unpinPage (BM_BufferPool *const bm, BM_PageHandle *const page);
 RC forcePage (BM_BufferPool *const bm, BM_PageHandle *const page);
 RC pinPage (BM_BufferPool *const bm, BM_PageHandle *const page, 
 		const PageNumber pageNum);
+RC prefetchPages (BM_BufferPool *const bm, const PageNumber startPage, const int count);
+RC pinPages (BM_BufferPool *const bm, BM_PageHandle *const handles,
+		const PageNumber *const pageNums, const int n);
+
+// Buffer Manager Interface Access Rings
+RC initAccessRing (BM_BufferPool *const bm, BM_AccessRing *const ring, const int numFrames);
+RC freeAccessRing (BM_AccessRing *const ring);
+RC pinPageWithRing (BM_BufferPool *const bm, BM_PageHandle *const page,
+		const PageNumber pageNum, BM_AccessRing *const ring);
+
+// Buffer Manager Interface Page Latches
+RC pinPageLatched (BM_BufferPool *const bm, BM_PageHandle *const page,
+		const PageNumber pageNum, const BM_LatchMode mode);
+RC pinPageWithRingLatched (BM_BufferPool *const bm, BM_PageHandle *const page,
+		const PageNumber pageNum, BM_AccessRing *const ring, const BM_LatchMode mode);
+
+// Buffer Manager Interface Optimistic Reads
+RC startOptimisticRead (BM_BufferPool *const bm, BM_PageHandle *const page,
+		const PageNumber pageNum, uint64_t *const version);
+bool validateOptimisticRead (BM_BufferPool *const bm, BM_PageHandle *const page,
+		const uint64_t version);
+RC readPageOptimistic (BM_BufferPool *const bm, const PageNumber pageNum, char *const buf);
 
 // Statistics Interface
 PageNumber *getFrameContents (BM_BufferPool *const bm);
@@ -64,34 +217,227 @@ bool *getDirtyFlags (BM_BufferPool *const bm);
 int *getFixCounts (BM_BufferPool *const bm);
 int getNumReadIO (BM_BufferPool *const bm);
 int getNumWriteIO (BM_BufferPool *const bm);
+int getNumWritesSaved (BM_BufferPool *const bm);
+int getNumResidentPages (BM_BufferPool *const bm);
+int getAdmissionSketchBytes (BM_BufferPool *const bm);
+int getNumAdmissionRejects (BM_BufferPool *const bm);
+int getReadAheadWindow (BM_BufferPool *const bm);
+int getNumPrefetchHits (BM_BufferPool *const bm);
+int getNumPrefetchWasted (BM_BufferPool *const bm);
+RC getPoolStats (BM_BufferPool *const bm, BM_PoolStats *const stats);
+
+// Doubly linked list of frames, threaded through Frame.listPrev/listNext.
+typedef struct FrameList {
+    int head;
+    int tail;
+    int size;
+} FrameList;
 
+// Per-frame state that victim scans read (fix counts, CLOCK reference
+// bits) is kept in dense arrays in the shard instead, see BM_Shard.
 typedef struct Frame {
     PageNumber pageNum;
     char *data;
-    bool dirty;
-    int fixCount;
-    int refCount;
     bool isDirty;
-	bool referenceBit;    
-    int lastUsed;          
-    int histIdx;           
-    int history[K_VAL]; 
-    struct Frame *next;
+    uint64_t lastUsed;     
+    uint64_t *history;       // RS_LRU_K: last K uncorrelated references, newest first
+    int heapPos;             // RS_LRU_K: position in the victim heap, -1 if pinned
+    bool loading;            // page is being read; pinners wait on the shard's loadDone
+    bool prefetched;         // loaded by the prefetcher and not pinned since
+    unsigned int generation; // bumped every time a new page is loaded
+    int id;                  // position in the pool as seen by getFrameContents
+    int listPrev;            // intrusive list links: a FrameList or an LFU bucket
+    int listNext;
+    FrameList *list;         // list the frame is on, NULL if none
+    int lfuBucket;           // RS_LFU frequency bucket holding this frame
 } Frame;
 
-typedef struct BM_MgmtData {
-    SM_FileHandle *fh;
+// Open-addressing index from page number to an item in an array whose
+// elements start with a PageNumber (frames, ghost entries).
+typedef struct PageIndex {
+    int *slots;
+    int mask;              // number of slots - 1 (a power of two)
+} PageIndex;
+
+// Ghost entries remember pages that are no longer resident: LRU-K keeps
+// their reference history, ARC their former list (B1 or B2), 2Q that they
+// passed through A1in. Entries sit on one of two recency lists.
+typedef struct GhostEntry {
+    PageNumber pageNum;
+    int prev;
+    int next;
+    int list;
+    uint64_t *history;
+} GhostEntry;
+
+typedef struct GhostTable {
+    GhostEntry *entries;
+    int capacity;
+    int limit;             // entries kept, at most capacity
+    PageIndex index;
+    int freeEntry;
+    int head[2];
+    int tail[2];
+    int size[2];
+    uint64_t *historyStore;
+} GhostTable;
+
+// Count-min sketch of page access frequencies for the admission filter:
+// four rows of saturating 4-bit counts (one per byte), all halved every
+// sampleSize additions so the estimates follow the recent past.
+typedef struct FreqSketch {
+    uint8_t *counters;
+    int mask;              // row width - 1 (a power of two)
+    int additions;
+    int sampleSize;
+} FreqSketch;
+
+// RS_LFU frequency bucket: all frames referenced freq times, most recent at
+// head. Buckets form an ascending list so the victim is found in O(1).
+typedef struct LFUBucket {
+    int freq;
+    int head;
+    int tail;
+    int prev;
+    int next;
+} LFUBucket;
+
+// One slot of an access ring: the frame the ring loaded (or adopted) and
+// what it looked like then. The frame is only recycled while its generation
+// and last use are unchanged, i.e. nobody else has pinned the page since.
+typedef struct RingSlot {
+    int frame;             // local frame index in the shard, -1 if none
+    unsigned int generation;
+    uint64_t lastUsed;
+} RingSlot;
+
+// Ring slots are split evenly between the shards, since a page can only
+// be loaded into a frame of its own shard.
+typedef struct BM_RingMgmt {
+    int perShard;
+    int *cursor;           // next slot to recycle, per shard
+    RingSlot *slots;       // perShard slots for each shard
+} BM_RingMgmt;
+
+// Frames are partitioned into shards by page-number hash. Each shard owns
+// its frames, page table and replacement state behind its own latch, so
+// threads working on different pages rarely contend.
+typedef struct BM_Shard {
     Frame *frames;
-    int numPages;
-    int readIO;
-    int writeIO;
-	Frame *clockHand;
-    Frame *fifoPtr;     
-	int timestamp;
-	int numWriteIO;
-	int numReadIO;
-} BM_MgmtData;
+    int numFrames;         // frames managed by the replacement strategy
+    int numWindow;         // admission window frames, stored after them
+    int capacity;          // frames allocated, the most resizeBufferPool may use
+    PageIndex pageTable;   // pageNum -> local frame index
+    int *fixCounts;        // per frame, updated atomically
+    uint64_t *refBits;     // RS_CLOCK reference bits, 64 frames per word
+    int clockHand;
+    int fifoPtr;
+    FrameList lru;         // unpinned frames, next LRU victim at the tail
+    uint64_t timestamp;
+    LFUBucket *lfuBuckets;
+    int lfuFirst;          // lowest-frequency bucket
+    int lfuFreeBucket;     // free list of unused bucket slots
+    int lfuDecayInterval;
+    int lfuSinceDecay;
+    int lrukK;
+    int lrukCorrelatedPeriod;
+    int *lrukHeap;         // unpinned frames ordered by K-th reference time
+    int lrukHeapSize;
+    FrameList lrukRecent;  // unpinned frames inside their correlated period
+    uint64_t *lrukHistoryStore;
+    GhostTable lrukHistory; // retained history of evicted pages
+    FrameList arcT1;       // RS_ARC: pages seen once recently
+    FrameList arcT2;       // RS_ARC: pages seen at least twice recently
+    int arcTarget;         // RS_ARC: adaptive target size of T1 (p)
+    bool arcDropVictim;    // RS_ARC: evict the next victim without a ghost
+    GhostTable arcGhosts;  // RS_ARC: B1 (list 0) and B2 (list 1)
+    FrameList q2A1in;      // RS_2Q: FIFO of pages referenced once
+    FrameList q2Am;        // RS_2Q: LRU of pages referenced again
+    int q2A1inMax;         // RS_2Q: Kin, A1in size that triggers its eviction
+    int q2InPercent;       // RS_2Q: Kin and Kout as shares of the shard
+    int q2OutPercent;
+    GhostTable q2A1out;    // RS_2Q: pages recently evicted from A1in
+    FrameList freeFrames;  // RS_ARC, RS_2Q: empty frames
+    FrameList window;      // admission window, LRU order
+    FreqSketch sketch;     // admission frequency estimates
+    int numAdmissionRejects;
+    int writerCursor;      // next frame the background writer looks at
+    int numPrefetched;     // pages read by the prefetcher
+    int numPrefetchHits;   // prefetched pages pinned before eviction
+    int numPrefetchWasted; // prefetched pages evicted without being pinned
+    pthread_cond_t loadDone; // signalled when a loading frame finishes
+    int numWaiters;        // pinners waiting in loadDone for a frame to load
+    int numReadIO;
+    int numWriteIO;
+    int numWriteErrors;    // failed background writes
+    uint64_t numHits;      // counters for BM_PoolStats, see getPoolStats
+    uint64_t numMisses;
+    uint64_t numEvictions[BM_NUM_EVICT_REASONS];
+    uint64_t numDirtyEvictions;
+    uint64_t numPinWaits;
+    uint64_t pinWaitNanos;
+    uint64_t pinLatency[BM_LATENCY_BUCKETS];
+    pthread_mutex_t latch;
+} BM_Shard;
 
+// A file a pool reads and writes. I/O counters and the open state are
+// guarded by the pool's I/O latch.
+typedef struct BM_FileMgmt {
+    SM_FileHandle fh;
+    char *name;
+    int refCount;          // attachments, 0 if the slot is free
+    bool closing;          // being detached: pages are written, not read
+    int numReadIO;
+    int numWriteIO;        // pages written
+    int numWritesSaved;    // pages written by a call that wrote an earlier one
+    int numResident;       // pages in the shards' page tables, updated atomically
+} BM_FileMgmt;
 
+typedef struct BM_MgmtData {
+    BM_FileMgmt *files;      // a private pool has only files[0]
+    bool shared;             // pages keyed by file as well, see pageKey
+    BM_Shard *shards;
+    int numShards;
+    int numPages;
+    int maxPages;            // frames reserved, see resizeBufferPool
+    char *arena;             // page data of every frame, frame i at i * PAGE_SIZE
+    size_t arenaSize;        // bytes mapped for the arena
+    uint64_t *pageLatches;   // latch word of each arena page, see page latches
+    bool latching;           // shard and I/O latches are only taken when set
+    pthread_mutex_t ioLatch; // serialises access to the shared file handle
+    int numDirty;            // dirty frames, updated atomically
+    Frame **flushFrames;     // forceFlushPool's sort buffer, maxPages entries
+    int numWritesSaved;      // all files', under the I/O latch
+    bool writerRunning;      // background writer state, see buffer_mgr.c
+    bool writerStop;
+    int dirtyHigh;           // numDirty above which the writer cleans
+    int dirtyLow;            // numDirty the writer cleans down to
+    int dirtyWatermark;      // dirtyHigh as a share of numPages
+    char *writerBuffer;
+    pthread_t writer;
+    pthread_mutex_t writerLatch;
+    pthread_cond_t writerWake;
+    PageNumber *prefetchQueue; // ring of pages waiting for the prefetcher
+    int prefetchHead;
+    int prefetchCount;
+    bool prefetcherRunning;
+    bool prefetchStop;
+    pthread_t prefetcher;
+    pthread_mutex_t prefetchLatch;
+    pthread_cond_t prefetchWake;
+    bool readAhead;            // sequential detection state, see buffer_mgr.c
+    int maxReadAhead;
+    PageNumber raLast;         // last page pinned
+    int raRun;                 // consecutive pins of the next page
+    int raWindow;              // current read-ahead window in pages
+    PageNumber raEnd;          // first page not yet requested
+    pthread_mutex_t raLatch;
+    char *warmFile;            // see warm restart in buffer_mgr.c, NULL if off
+    bool pinLatency;           // pins are timed into the shards' pinLatency
+    FILE *trace;               // see tracing in buffer_mgr.c, NULL if off
+    unsigned char *traceBuffer;
+    int traceBytes;
+    pthread_mutex_t traceLatch;
+} BM_MgmtData;
 
 #endif
\ No newline at end of file
@@ -3,9 +3,17 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <inttypes.h>
 
 // local functions
 static void printStrat (BM_BufferPool *const bm);
+static const char *strategyName (ReplacementStrategy strategy);
+static int appendf (char *buf, int size, int pos, const char *format, ...);
+
+static const char *evictReasonNames[BM_NUM_EVICT_REASONS] = {
+	"miss", "prefetch", "ring", "resize", "detach", "reload"
+};
 
 // external functions
 void 
@@ -29,6 +37,63 @@ printPoolContent (BM_BufferPool *const bm)
 	printf("\n");
 }
 
+// I/O counters, plus the admission filter and prefetch state when in use
+void
+printPoolStats (BM_BufferPool *const bm)
+{
+	int sketchBytes = getAdmissionSketchBytes(bm);
+	int window = getReadAheadWindow(bm);
+	int prefetchHits = getNumPrefetchHits(bm);
+	int prefetchWasted = getNumPrefetchWasted(bm);
+	BM_BufferPool *shared = getSharedBufferPool();
+
+	printf("{");
+	printStrat(bm);
+	printf(" %i}: reads=%i writes=%i", bm->numPages, getNumReadIO(bm), getNumWriteIO(bm));
+	if (shared != NULL && bm->mgmtData == shared->mgmtData)
+		printf(" shared: file=%i resident=%i", bm->fileId, getNumResidentPages(bm));
+	if (sketchBytes > 0)
+		printf(" admission: sketch=%iB rejected=%i", sketchBytes, getNumAdmissionRejects(bm));
+	if (window > 0 || prefetchHits > 0 || prefetchWasted > 0)
+		printf(" read-ahead: window=%i hits=%i wasted=%i", window, prefetchHits, prefetchWasted);
+	printf("\n");
+}
+
+// getPoolStats as one JSON object, written into buf (size bytes, the
+// terminating NUL included) without allocating. Returns the length of the
+// whole object like snprintf, so a result >= size means buf was too small
+// and holds a truncated object; -1 if bm has no pool.
+int
+sprintPoolStatsJSON (BM_BufferPool *const bm, char *buf, int size)
+{
+	BM_PoolStats st;
+	const char *name = strategyName(bm->strategy);
+	int pos = 0;
+	int i;
+
+	if (getPoolStats(bm, &st) != RC_OK)
+		return -1;
+
+	pos = appendf(buf, size, pos, "{\"strategy\":\"%s\",\"numPages\":%i,", name != NULL ? name : "?", st.numPages);
+	pos = appendf(buf, size, pos, "\"residentPages\":%i,\"dirtyPages\":%i,\"pinnedPages\":%i,",
+			st.residentPages, st.dirtyPages, st.pinnedPages);
+	pos = appendf(buf, size, pos, "\"hits\":%" PRIu64 ",\"misses\":%" PRIu64 ",\"hitRatio\":%.4f,",
+			st.hits, st.misses, st.hits + st.misses > 0 ? (double) st.hits / (st.hits + st.misses) : 0.0);
+	pos = appendf(buf, size, pos, "\"evictions\":{");
+	for (i = 0; i < BM_NUM_EVICT_REASONS; i++)
+		pos = appendf(buf, size, pos, "%s\"%s\":%" PRIu64, (i == 0) ? "" : ",", evictReasonNames[i], st.evictions[i]);
+	pos = appendf(buf, size, pos, "},\"dirtyEvictions\":%" PRIu64 ",\"pinWaits\":%" PRIu64 ",\"pinWaitNanos\":%" PRIu64 ",",
+			st.dirtyEvictions, st.pinWaits, st.pinWaitNanos);
+	pos = appendf(buf, size, pos, "\"pinLatencyLog2Nanos\":[");
+	for (i = 0; i < BM_LATENCY_BUCKETS; i++)
+		pos = appendf(buf, size, pos, "%s%" PRIu64, (i == 0) ? "" : ",", st.pinLatency[i]);
+	pos = appendf(buf, size, pos, "],\"readIO\":%i,\"writeIO\":%i,\"writesSaved\":%i,\"writeErrors\":%i,",
+			st.readIO, st.writeIO, st.writesSaved, st.writeErrors);
+	pos = appendf(buf, size, pos, "\"prefetchHits\":%i,\"prefetchWasted\":%i,\"admissionRejects\":%i}",
+			st.prefetchHits, st.prefetchWasted, st.admissionRejects);
+	return pos;
+}
+
 char *
 sprintPoolContent (BM_BufferPool *const bm)
 {
@@ -81,25 +146,51 @@ sprintPageContent (BM_PageHandle *const page)
 void
 printStrat (BM_BufferPool *const bm)
 {
-	switch (bm->strategy)
+	const char *name = strategyName(bm->strategy);
+
+	if (name != NULL)
+		printf("%s", name);
+	else
+		printf("%i", bm->strategy);
+}
+
+static const char *
+strategyName (ReplacementStrategy strategy)
+{
+	switch (strategy)
 	{
 	case RS_FIFO:
-		printf("FIFO");
-		break;
+		return "FIFO";
 	case RS_LRU:
-		printf("LRU");
-		break;
+		return "LRU";
 	case RS_CLOCK:
-		printf("CLOCK");
-		break;
+		return "CLOCK";
 	case RS_LFU:
-		printf("LFU");
-		break;
+		return "LFU";
 	case RS_LRU_K:
-		printf("LRU-K");
-		break;
+		return "LRU-K";
+	case RS_ARC:
+		return "ARC";
+	case RS_2Q:
+		return "2Q";
 	default:
-		printf("%i", bm->strategy);
-		break;
+		return NULL;
 	}
 }
+
+// printf at buf + pos as far as size allows; returns pos advanced by the
+// full length, so the caller learns how much room the whole text needs
+static int
+appendf (char *buf, int size, int pos, const char *format, ...)
+{
+	va_list args;
+	int n;
+
+	va_start(args, format);
+	if (pos < size)
+		n = vsnprintf(buf + pos, size - pos, format, args);
+	else
+		n = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	return pos + n;
+}
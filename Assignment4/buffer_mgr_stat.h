@@ -5,8 +5,10 @@
 
 // debug functions
 void printPoolContent (BM_BufferPool *const bm);
+void printPoolStats (BM_BufferPool *const bm);
 void printPageContent (BM_PageHandle *const page);
 char *sprintPoolContent (BM_BufferPool *const bm);
 char *sprintPageContent (BM_PageHandle *const page);
+int sprintPoolStatsJSON (BM_BufferPool *const bm, char *buf, int size);
 
 #endif
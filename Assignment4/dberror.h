@@ -29,6 +29,8 @@ typedef int RC;
 #define RC_IM_N_TO_LAGE 302
 #define RC_IM_NO_MORE_ENTRIES 303
 #define RC_BUFFER_POOL_FULL 500
+#define RC_BUFFER_PAGE_NOT_RESIDENT 501
+#define RC_BUFFER_PAGE_BUSY 502
 #define RC_ERROR 600
 
 /* holder for error messages */
@@ -133,6 +133,7 @@ RC insertRecord(RM_TableData *rel, Record *record) {
     RC rc;
 
     int recordSize = getRecordSize(rel->schema);
+    if (recordSize < 1) return RC_ERROR;
     int slotSize = recordSize;
     int slotsPerPage = PAGE_SIZE / slotSize;
     int pageNum = 1;
@@ -140,7 +141,7 @@ RC insertRecord(RM_TableData *rel, Record *record) {
 
 while (!inserted) {
     printf("Trying page %d...\n", pageNum); fflush(stdout);
-    rc = pinPage(bm, &page, pageNum);
+    rc = pinPageLatched(bm, &page, pageNum, BM_LATCH_EXCLUSIVE);
     printf(">>> pinPage result = %d\n", rc); fflush(stdout);
     if (rc != RC_OK) {
         printf("Page %d does not exist. Creating new page...\n", pageNum); fflush(stdout);
@@ -151,15 +152,15 @@ while (!inserted) {
         if (capRC != RC_OK) return capRC;
 
         capRC = ensureCapacity(pageNum + 1, &fh);
-        if (capRC != RC_OK) return capRC;
-
         closePageFile(&fh);
+        if (capRC != RC_OK) return capRC;
 
-        rc = pinPage(bm, &page, pageNum);
+        rc = pinPageLatched(bm, &page, pageNum, BM_LATCH_EXCLUSIVE);
         if (rc != RC_OK) return rc;
         if (page.data == NULL) {
             printf("ERROR: pinPage returned NULL data\n");
-            return RC_ERROR;
+            rc = RC_ERROR;
+            goto out;
     }
 
         memset(page.data, 0, PAGE_SIZE);
@@ -171,13 +172,12 @@ while (!inserted) {
             if (page.data[offset] == 0) {
                 printf("Inserting at page %d, slot %d\n", pageNum, slot); fflush(stdout);
                 page.data[offset] = 1;
-                if (recordSize < 1) return RC_ERROR;
                 memcpy(page.data + offset + 1, record->data, recordSize - 1);
                 record->id.page = pageNum;
                 record->id.slot = slot;
 
                 rc = markDirty(bm, &page);
-                if (rc != RC_OK) return rc;
+                if (rc != RC_OK) goto out;
                 rc = unpinPage(bm, &page);
                 if (rc != RC_OK) return rc;
 
@@ -195,6 +195,11 @@ while (!inserted) {
     }
 
     return RC_OK;
+
+// Failures while page is pinned must still drop the pin and its latch.
+out:
+    unpinPage(bm, &page);
+    return rc;
 }
 
 RC getRecord(RM_TableData *rel, RID id, Record *record) {
@@ -206,7 +211,7 @@ RC getRecord(RM_TableData *rel, RID id, Record *record) {
     int recordSize = getRecordSize(rel->schema);
     int offset = id.slot * recordSize;
 
-    rc = pinPage(bm, &page, id.page);
+    rc = pinPageLatched(bm, &page, id.page, BM_LATCH_SHARED);
     if (rc != RC_OK) return rc;
 
     if (page.data[offset] == 0) {
@@ -234,7 +239,7 @@ RC updateRecord(RM_TableData *rel, Record *record) {
     int recordSize = getRecordSize(rel->schema);
     int offset = record->id.slot * recordSize;
 
-    rc = pinPage(bm, &page, record->id.page);
+    rc = pinPageLatched(bm, &page, record->id.page, BM_LATCH_EXCLUSIVE);
     if (rc != RC_OK) return rc;
 
     if (page.data[offset] == 0) {
@@ -245,7 +250,10 @@ RC updateRecord(RM_TableData *rel, Record *record) {
     memcpy(page.data + offset + 1, record->data, recordSize - 1);
 
     rc = markDirty(bm, &page);
-    if (rc != RC_OK) return rc;
+    if (rc != RC_OK) {
+        unpinPage(bm, &page);
+        return rc;
+    }
 
     rc = unpinPage(bm, &page);
     if (rc != RC_OK) return rc;
@@ -262,7 +270,7 @@ RC deleteRecord(RM_TableData *rel, RID id) {
     int recordSize = getRecordSize(rel->schema);
     int offset = id.slot * recordSize;
 
-    rc = pinPage(bm, &page, id.page);
+    rc = pinPageLatched(bm, &page, id.page, BM_LATCH_EXCLUSIVE);
     if (rc != RC_OK) return rc;
 
     if (page.data[offset] == 0) {
@@ -273,7 +281,10 @@ RC deleteRecord(RM_TableData *rel, RID id) {
     page.data[offset] = 0;
 
     rc = markDirty(bm, &page);
-    if (rc != RC_OK) return rc;
+    if (rc != RC_OK) {
+        unpinPage(bm, &page);
+        return rc;
+    }
 
     rc = unpinPage(bm, &page);
     if (rc != RC_OK) return rc;
@@ -283,10 +294,15 @@ RC deleteRecord(RM_TableData *rel, RID id) {
     return RC_OK;
 }
 
+// Frames a scan recycles, so a full-table scan does not push the pages of
+// concurrent lookups out of the table's buffer pool.
+#define SCAN_RING_FRAMES 16
+
 typedef struct RM_ScanHandle_Mgmt {
     int page;
     int slot;
     Expr *cond;
+    BM_AccessRing ring;
 } RM_ScanHandle_Mgmt;
 
 RC initRecordManager(void *mgmtData) {
@@ -325,9 +341,17 @@ RC createTable(char *name, Schema *schema) {
 }
 
 
+// Tables share the process-wide buffer pool when one was created with
+// initSharedBufferPool, and get a private pool otherwise.
 RC openTable(RM_TableData *rel, char *name) {
     RM_MetaData *meta = malloc(sizeof(RM_MetaData));
-    initBufferPool(&meta->bufferPool, name, 100, RS_FIFO, NULL);
+    RC rc = getSharedBufferPool() != NULL
+                ? attachBufferPool(&meta->bufferPool, name)
+                : initBufferPool(&meta->bufferPool, name, 100, RS_FIFO, NULL);
+    if (rc != RC_OK) {
+        free(meta);
+        return rc;
+    }
 
     printf(">> openTable() name = %s\n", name); fflush(stdout);
     printf(">> bm->pageFile = %s\n", meta->bufferPool.pageFile); fflush(stdout);
@@ -358,10 +382,16 @@ int getNumTuples(RM_TableData *rel) {
 }
 
 RC startScan(RM_TableData *rel, RM_ScanHandle *scan, Expr *cond) {
+    RM_MetaData *meta = rel->mgmtData;
     RM_ScanHandle_Mgmt *mgmt = malloc(sizeof(RM_ScanHandle_Mgmt));
     mgmt->page = 1;
     mgmt->slot = 0;
     mgmt->cond = cond;
+    RC rc = initAccessRing(&meta->bufferPool, &mgmt->ring, SCAN_RING_FRAMES);
+    if (rc != RC_OK) {
+        free(mgmt);
+        return rc;
+    }
 
     scan->rel = rel;
     scan->mgmtData = mgmt;
@@ -378,7 +408,9 @@ RC next(RM_ScanHandle *scan, Record *record) {
     int slots = PAGE_SIZE / size;
 
     while (mgmt->page < 1000) {
-        pinPage(bm, &page, mgmt->page);
+        // shared, so inserts and updates cannot change the page under the scan
+        RC rc = pinPageWithRingLatched(bm, &page, mgmt->page, &mgmt->ring, BM_LATCH_SHARED);
+        if (rc != RC_OK) return rc;
         while (mgmt->slot < slots) {
             int offset = mgmt->slot * size;
             if (page.data[offset] == 1) {
@@ -392,7 +424,7 @@ RC next(RM_ScanHandle *scan, Record *record) {
                 mgmt->slot++;
                 if (result->v.boolV) {
                     unpinPage(bm, &page);
-                    RC rc = RC_OK;
+                    rc = RC_OK;
                     free(result);
                     return rc;
                 }
@@ -409,7 +441,9 @@ RC next(RM_ScanHandle *scan, Record *record) {
 }
 
 RC closeScan(RM_ScanHandle *scan) {
-    free(scan->mgmtData);
+    RM_ScanHandle_Mgmt *mgmt = scan->mgmtData;
+    freeAccessRing(&mgmt->ring);
+    free(mgmt);
     return RC_OK;
 }
 
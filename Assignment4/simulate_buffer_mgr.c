@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "buffer_mgr.h"
+#include "storage_mgr.h"
+#include "dberror.h"
+
+// Replays a trace recorded with traceFile in BM_PoolConfig against every
+// replacement strategy at pool sizes from minFrames up to maxFrames,
+// doubling each time, and prints the miss-ratio curve as CSV. The pages of
+// the trace are renumbered densely in the order they first appear, so
+// traces from the shared pool replay against a single scratch file.
+
+#define SIM_FILE "simulate_buffer.bin"
+#define DEFAULT_MIN_FRAMES 16
+
+typedef struct SimStrategy {
+    char *name;
+    ReplacementStrategy strategy;
+    void *stratData;
+} SimStrategy;
+
+static BM_LFUParams lfuAging = { .decayInterval = 10000 };
+static BM_LRUKParams lru3 = { .k = 3 };
+
+static SimStrategy simStrategies[] = {
+    { "FIFO", RS_FIFO, NULL },
+    { "LRU", RS_LRU, NULL },
+    { "CLOCK", RS_CLOCK, NULL },
+    { "LFU", RS_LFU, NULL },
+    { "LFU-aging", RS_LFU, &lfuAging },
+    { "LRU-2", RS_LRU_K, NULL },
+    { "LRU-3", RS_LRU_K, &lru3 },
+    { "ARC", RS_ARC, NULL },
+    { "2Q", RS_2Q, NULL },
+};
+#define NUM_SIM_STRATEGIES (int)(sizeof(simStrategies) / sizeof(simStrategies[0]))
+
+typedef struct Trace {
+    uint32_t *records;         // dense page id << 1 | BM_TRACE_UNPIN bit
+    int numRecords;
+    int numPins;
+    int numPages;              // distinct pages
+} Trace;
+
+// Open-addressing map from trace keys to dense page ids.
+typedef struct KeyMap {
+    uint32_t *keys;
+    int *ids;
+    int capacity;
+} KeyMap;
+
+static int mapKey(KeyMap *m, uint32_t key, int *numPages) {
+    uint32_t slot = key * 2654435761u & (m->capacity - 1);
+    while (m->ids[slot] >= 0) {
+        if (m->keys[slot] == key) return m->ids[slot];
+        slot = (slot + 1) & (m->capacity - 1);
+    }
+    m->keys[slot] = key;
+    m->ids[slot] = (*numPages)++;
+    return m->ids[slot];
+}
+
+static void loadTrace(const char *fileName, Trace *t) {
+    FILE *fp = fopen(fileName, "rb");
+    char magic[8];
+    if (fp == NULL || fread(magic, 1, 8, fp) != 8 || memcmp(magic, BM_TRACE_MAGIC, 8) != 0) {
+        printf("%s is not a buffer pool trace\n", fileName);
+        exit(1);
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp) - 8;
+    fseek(fp, 8, SEEK_SET);
+    // a partial record means the file was cut short while being written
+    if (size % 4 != 0) {
+        printf("%s is truncated\n", fileName);
+        exit(1);
+    }
+    t->numRecords = (int)(size / 4);
+    t->records = malloc((size_t)t->numRecords * sizeof(uint32_t) + 1);
+    unsigned char *raw = malloc((size_t)size + 1);
+    if (t->records == NULL || raw == NULL ||
+        fread(raw, 1, (size_t)size, fp) != (size_t)size) {
+        printf("cannot read %s\n", fileName);
+        exit(1);
+    }
+    fclose(fp);
+
+    KeyMap m;
+    m.capacity = 1024;
+    while (m.capacity < 2 * t->numRecords) m.capacity *= 2;
+    m.keys = malloc(m.capacity * sizeof(uint32_t));
+    m.ids = malloc(m.capacity * sizeof(int));
+    memset(m.ids, -1, m.capacity * sizeof(int));
+    t->numPages = 0;
+    t->numPins = 0;
+    for (int i = 0; i < t->numRecords; i++) {
+        unsigned char *r = raw + 4 * i;
+        uint32_t record = r[0] | r[1] << 8 | r[2] << 16 | (uint32_t)r[3] << 24;
+        uint32_t op = record & BM_TRACE_UNPIN;
+        t->records[i] = (uint32_t)mapKey(&m, record >> 1, &t->numPages) << 1 | op;
+        if (op != BM_TRACE_UNPIN) t->numPins++;
+    }
+    free(m.keys);
+    free(m.ids);
+    free(raw);
+}
+
+// Page files are created sparse so large traces do not need real disk space.
+static void createSimFile(int numPages) {
+    FILE *fp = fopen(SIM_FILE, "wb");
+    if (fp == NULL || ftruncate(fileno(fp), (off_t)numPages * PAGE_SIZE) != 0) {
+        printf("cannot create %s\n", SIM_FILE);
+        exit(1);
+    }
+    fclose(fp);
+}
+
+// Replays the trace once. Each page keeps the handle of its latest pin for
+// the unpins; a pin that fails because every frame is pinned is counted and
+// its unpin skipped.
+static void replay(const Trace *t, SimStrategy *ss, int frames, BM_PageHandle *handles,
+                   int *pinned) {
+    BM_BufferPool bm;
+    int failed = 0;
+
+    memset(pinned, 0, t->numPages * sizeof(int));
+    CHECK(initBufferPool(&bm, SIM_FILE, frames, ss->strategy, ss->stratData));
+    for (int i = 0; i < t->numRecords; i++) {
+        int page = t->records[i] >> 1;
+        if ((t->records[i] & BM_TRACE_UNPIN) == 0) {
+            if (pinPage(&bm, &handles[page], page) == RC_OK) pinned[page]++;
+            else failed++;
+        } else if (pinned[page] > 0) {
+            CHECK(unpinPage(&bm, &handles[page]));
+            pinned[page]--;
+        }
+    }
+    int misses = getNumReadIO(&bm);
+    for (int page = 0; page < t->numPages; page++) {
+        while (pinned[page]-- > 0) unpinPage(&bm, &handles[page]);
+    }
+    CHECK(shutdownBufferPool(&bm));
+    printf("%s,%d,%d,%d,%.4f,%d\n", ss->name, frames, t->numPins, misses,
+           t->numPins > 0 ? (double)misses / t->numPins : 0.0, failed);
+}
+
+static void usage(const char *prog) {
+    printf("usage: %s trace [minFrames [maxFrames]]\n", prog);
+    printf("  maxFrames defaults to the number of distinct pages, rounded up to a power of two\n");
+}
+
+int main(int argc, char *argv[]) {
+    Trace t;
+
+    if (argc < 2 || argc > 4) {
+        usage(argv[0]);
+        return 1;
+    }
+    loadTrace(argv[1], &t);
+    int minFrames = argc > 2 ? atoi(argv[2]) : DEFAULT_MIN_FRAMES;
+    int maxFrames = 1;
+    while (maxFrames < t.numPages) maxFrames *= 2;
+    if (argc > 3) maxFrames = atoi(argv[3]);
+    if (minFrames < 1 || maxFrames < minFrames) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    BM_PageHandle *handles = calloc(t.numPages + 1, sizeof(BM_PageHandle));
+    int *pinned = malloc((t.numPages + 1) * sizeof(int));
+    initStorageManager();
+    createSimFile(t.numPages);
+    printf("# %d records, %d pins, %d distinct pages\n", t.numRecords, t.numPins, t.numPages);
+    printf("strategy,frames,pins,misses,miss_ratio,failed_pins\n");
+    for (int s = 0; s < NUM_SIM_STRATEGIES; s++) {
+        for (int frames = minFrames; frames <= maxFrames; frames *= 2)
+            replay(&t, &simStrategies[s], frames, handles, pinned);
+    }
+    destroyPageFile(SIM_FILE);
+    free(handles);
+    free(pinned);
+    free(t.records);
+    return 0;
+}
@@ -1,21 +1,30 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
 
 #include "storage_mgr.h"
 
+#define IOV_BLOCKS 64  // blocks per preadv/pwritev call
+
 void initStorageManager(void) {
 }
 
 RC appendEmptyBlock(SM_FileHandle *fHandle) {
-    RC rc = ensureCapacity(fHandle->totalNumPages + 1, fHandle);
-    if (rc != RC_OK)
-        return rc;
-
+    FILE *fp = (FILE *)fHandle->mgmtInfo;
     SM_PageHandle emptyPage = (SM_PageHandle) calloc(PAGE_SIZE, sizeof(char));
-    rc = writeBlock(fHandle->totalNumPages, fHandle, emptyPage);
+    if (emptyPage == NULL)
+        return RC_NOMEM;
+
+    fseek(fp, 0L, SEEK_END);
+    size_t written = fwrite(emptyPage, sizeof(char), PAGE_SIZE, fp);
     free(emptyPage);
-    return rc;
+    if (written != PAGE_SIZE)
+        return RC_WRITE_FAILED;
+
+    fHandle->totalNumPages += 1;
+    return RC_OK;
 }
 
 RC createPageFile(char *fileName) {
@@ -72,20 +81,76 @@ RC readBlock(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage) {
     return RC_OK;
 }
 
+// Read numPages consecutive blocks starting at pageNum into the buffers in
+// memPages, one per block, with as few system calls as the kernel allows.
+RC readBlocks(int pageNum, int numPages, SM_FileHandle *fHandle, SM_PageHandle *memPages) {
+    if (pageNum < 0 || numPages < 0 || pageNum + numPages > fHandle->totalNumPages)
+        return RC_READ_NON_EXISTING_PAGE;
+
+    FILE *fp = (FILE *)fHandle->mgmtInfo;
+    fflush(fp);  // the read goes around the stream, so it must not hold writes
+    int fd = fileno(fp);
+    struct iovec iov[IOV_BLOCKS];
+    int done = 0;
+    while (done < numPages) {
+        int n = numPages - done < IOV_BLOCKS ? numPages - done : IOV_BLOCKS;
+        for (int i = 0; i < n; i++) {
+            iov[i].iov_base = memPages[done + i];
+            iov[i].iov_len = PAGE_SIZE;
+        }
+        ssize_t got = preadv(fd, iov, n, (off_t)(pageNum + done) * PAGE_SIZE);
+        if (got < PAGE_SIZE) return RC_READ_NON_EXISTING_PAGE;
+        done += (int)(got / PAGE_SIZE);  // a short read is continued from its last whole block
+    }
+    fHandle->curPagePos = pageNum + numPages - 1;
+
+    return RC_OK;
+}
+
 RC writeBlock(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage) {
-    printf("Simulated writeBlock called for page %d\n", pageNum);
+    if (pageNum >= fHandle->totalNumPages || pageNum < 0)
+        return RC_WRITE_FAILED;
+
+    FILE *fp = (FILE *)fHandle->mgmtInfo;
+    fseek(fp, pageNum * PAGE_SIZE, SEEK_SET);
+    if (fwrite(memPage, sizeof(char), PAGE_SIZE, fp) != PAGE_SIZE)
+        return RC_WRITE_FAILED;
+    fHandle->curPagePos = pageNum;
+
     return RC_OK;
 }
 
-RC ensureCapacity(int numberOfPages, SM_FileHandle *fHandle) {
-    if (fHandle->totalNumPages < numberOfPages) {
-        int pagesToAdd = numberOfPages - fHandle->totalNumPages;
-        SM_PageHandle emptyPage = (SM_PageHandle) malloc(PAGE_SIZE);
-        memset(emptyPage, 0, PAGE_SIZE);
-        for (int i = 0; i < pagesToAdd; i++) {
-            appendEmptyBlock(fHandle);
+// Write the buffers in memPages to numPages consecutive blocks starting at
+// pageNum, the counterpart of readBlocks.
+RC writeBlocks(int pageNum, int numPages, SM_FileHandle *fHandle, SM_PageHandle *memPages) {
+    if (pageNum < 0 || numPages < 0 || pageNum + numPages > fHandle->totalNumPages)
+        return RC_WRITE_FAILED;
+
+    FILE *fp = (FILE *)fHandle->mgmtInfo;
+    fflush(fp);  // nothing buffered may land after, or be read back instead of, this write
+    int fd = fileno(fp);
+    struct iovec iov[IOV_BLOCKS];
+    int done = 0;
+    while (done < numPages) {
+        int n = numPages - done < IOV_BLOCKS ? numPages - done : IOV_BLOCKS;
+        for (int i = 0; i < n; i++) {
+            iov[i].iov_base = memPages[done + i];
+            iov[i].iov_len = PAGE_SIZE;
         }
-        free(emptyPage);
+        ssize_t put = pwritev(fd, iov, n, (off_t)(pageNum + done) * PAGE_SIZE);
+        if (put < PAGE_SIZE) return RC_WRITE_FAILED;
+        done += (int)(put / PAGE_SIZE);
+    }
+    fHandle->curPagePos = pageNum + numPages - 1;
+
+    return RC_OK;
+}
+
+RC ensureCapacity(int numberOfPages, SM_FileHandle *fHandle) {
+    while (fHandle->totalNumPages < numberOfPages) {
+        RC rc = appendEmptyBlock(fHandle);
+        if (rc != RC_OK)
+            return rc;
     }
     return RC_OK;
 }
@@ -0,0 +1,1770 @@
+#include "storage_mgr.h"
+#include "buffer_mgr_stat.h"
+#include "buffer_mgr.h"
+#include "dberror.h"
+#include "test_helper.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// var to store the current test's name
+char *testName;
+
+// check whether two the content of a buffer pool is the same as an expected content
+// (given in the format produced by sprintPoolContent)
+#define ASSERT_EQUALS_POOL(expected,bm,message)                    \
+do {                                    \
+char *real;                                \
+char *_exp = (char *) (expected);                                   \
+real = sprintPoolContent(bm);                    \
+if (strcmp((_exp),real) != 0)                    \
+{                                    \
+printf("[%s-%s-L%i-%s] FAILED: expected <%s> but was <%s>: %s\n",TEST_INFO, _exp, real, message); \
+free(real);                            \
+exit(1);                            \
+}                                    \
+printf("[%s-%s-L%i-%s] OK: expected <%s> and was <%s>: %s\n",TEST_INFO, _exp, real, message); \
+free(real);                                \
+} while(0)
+
+// test and helper methods
+static void createDummyPages(BM_BufferPool *bm, int num);
+static void runRequests(BM_BufferPool *bm, const int *requests, const char **poolContents, int num);
+
+static void testLRUKCorrelatedPeriod (void);
+static void testARCGhostHits (void);
+static void test2QGhostHits (void);
+static void testShrinkPinned (void);
+static void testSharedPoolDetach (void);
+static void testOptimisticReadAfterLatch (void);
+static void testPinPagesPartialFailure (void);
+static void testPageTableCollisions (void);
+static void testStaleHandle (void);
+static void testConcurrentPins (void);
+static void testLRUWidePool (void);
+static void testClockWordBoundary (void);
+static void testAdmission (void);
+static void testBackgroundWriter (void);
+static void testPrefetch (void);
+static void testReadAhead (void);
+static void testAccessRing (void);
+static void testResizeAlignment (void);
+static void testWarmRestart (void);
+static void testFlushCoalescing (void);
+static void testPoolStats (void);
+static void testTraceRoundTrip (void);
+
+// main method
+int
+main (void)
+{
+    initStorageManager();
+    testName = "";
+
+    testLRUKCorrelatedPeriod();
+    testARCGhostHits();
+    test2QGhostHits();
+    testShrinkPinned();
+    testSharedPoolDetach();
+    testOptimisticReadAfterLatch();
+    testPinPagesPartialFailure();
+    testPageTableCollisions();
+    testStaleHandle();
+    testConcurrentPins();
+    testLRUWidePool();
+    testClockWordBoundary();
+    testAdmission();
+    testBackgroundWriter();
+    testPrefetch();
+    testReadAhead();
+    testAccessRing();
+    testResizeAlignment();
+    testWarmRestart();
+    testFlushCoalescing();
+    testPoolStats();
+    testTraceRoundTrip();
+    return 0;
+}
+
+
+void
+createDummyPages(BM_BufferPool *bm, int num)
+{
+    int i;
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+
+    CHECK(createPageFile("testbuffer.bin"));
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+
+    for (i = 0; i < num; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        sprintf(h->data, "%s-%i", "Page", h->pageNum);
+        CHECK(markDirty(bm, h));
+        CHECK(unpinPage(bm,h));
+    }
+
+    CHECK(shutdownBufferPool(bm));
+
+    free(h);
+}
+
+// pin and directly unpin each requested page, checking the pool after each
+void
+runRequests(BM_BufferPool *bm, const int *requests, const char **poolContents, int num)
+{
+    int i;
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+
+    for (i = 0; i < num; i++)
+    {
+        CHECK(pinPage(bm, h, requests[i]));
+        CHECK(unpinPage(bm, h));
+        ASSERT_EQUALS_POOL(poolContents[i], bm, "check pool content using pages");
+    }
+
+    free(h);
+}
+
+// LRU-2 with a correlated reference period of two pins: a re-reference
+// within the period does not count as a second reference, and a page
+// still inside its period is passed over for eviction
+void
+testLRUKCorrelatedPeriod (void)
+{
+    // expected results
+    const char *poolContents[] = {
+        "[1 0],[-1 0],[-1 0]",
+        "[1 0],[0 0],[-1 0]",
+        // correlated with the previous pin, page 0 keeps a single reference
+        "[1 0],[0 0],[-1 0]",
+        "[1 0],[0 0],[2 0]",
+        // four pins after its first one, page 1 gets its second reference
+        "[1 0],[0 0],[2 0]",
+        // pages 0 and 2 have one reference each, page 0 is older
+        "[1 0],[3 0],[2 0]",
+        "[1 0],[3 0],[2 0]",
+        // page 3 has the fewest references but was pinned within the period
+        "[5 0],[3 0],[2 0]"
+    };
+    const int requests[] = {1,0,0,2,1,3,2,5};
+    const int numRequests = 8;
+    BM_LRUKParams params = { .k = 2, .correlatedPeriod = 2 };
+
+    BM_BufferPool *bm = MAKE_POOL();
+    testName = "Testing LRU-K correlated reference period";
+
+    createDummyPages(bm, 10);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_LRU_K, &params));
+
+    runRequests(bm, requests, poolContents, numRequests);
+
+    ASSERT_EQUALS_INT(0, getNumWriteIO(bm), "check number of write I/Os");
+    ASSERT_EQUALS_INT(5, getNumReadIO(bm), "check number of read I/Os");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    TEST_DONE();
+}
+
+// ARC: a miss on a page in B1 grows T1's target and loads the page into T2,
+// a miss on a page in B2 shrinks the target again
+void
+testARCGhostHits (void)
+{
+    // expected results
+    const char *poolContents[] = {
+        "[0 0],[-1 0],[-1 0]",
+        "[0 0],[1 0],[-1 0]",
+        "[0 0],[1 0],[2 0]",
+        // the second reference moves page 0 to T2
+        "[0 0],[1 0],[2 0]",
+        // T1 is above its target of 0, its oldest page 1 goes to B1
+        "[0 0],[3 0],[2 0]",
+        // B1 hit: the target grows to 1, page 2 goes to B1, page 1 to T2
+        "[0 0],[3 0],[1 0]",
+        // T1 is at its target, so T2's oldest page 0 goes to B2
+        "[4 0],[3 0],[1 0]",
+        "[4 0],[5 0],[1 0]",
+        // B2 hit: the target shrinks to 0, T1 gives up page 4
+        "[0 0],[5 0],[1 0]",
+        // pages 0 and 1 are both in T2, so T1 keeps losing its pages
+        "[0 0],[6 0],[1 0]"
+    };
+    const int requests[] = {0,1,2,0,3,1,4,5,0,6};
+    const int numRequests = 10;
+
+    BM_BufferPool *bm = MAKE_POOL();
+    testName = "Testing ARC ghost hits";
+
+    createDummyPages(bm, 10);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_ARC, NULL));
+
+    runRequests(bm, requests, poolContents, numRequests);
+
+    ASSERT_EQUALS_INT(0, getNumWriteIO(bm), "check number of write I/Os");
+    ASSERT_EQUALS_INT(9, getNumReadIO(bm), "check number of read I/Os");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    TEST_DONE();
+}
+
+// 2Q with Kin = 1 frame and Kout = 2 pages: pages referenced once are
+// recycled through A1in, and a miss on a page remembered in A1out loads it
+// into Am, where the pages passing through A1in cannot evict it
+void
+test2QGhostHits (void)
+{
+    // expected results
+    const char *poolContents[] = {
+        "[0 0],[-1 0],[-1 0],[-1 0]",
+        "[0 0],[1 0],[-1 0],[-1 0]",
+        "[0 0],[1 0],[2 0],[-1 0]",
+        "[0 0],[1 0],[2 0],[3 0]",
+        // A1in is over Kin, its oldest page 0 goes to A1out
+        "[4 0],[1 0],[2 0],[3 0]",
+        // A1out hit: page 0 comes back into Am, page 1 goes to A1out
+        "[4 0],[0 0],[2 0],[3 0]",
+        "[4 0],[0 0],[5 0],[3 0]",
+        "[4 0],[0 0],[5 0],[3 0]",
+        "[4 0],[0 0],[5 0],[6 0]",
+        "[7 0],[0 0],[5 0],[6 0]",
+        // page 3 is still in A1out (pages 1 and 2 have been dropped)
+        "[7 0],[0 0],[3 0],[6 0]",
+        // only A1in pages are recycled from now on
+        "[7 0],[0 0],[3 0],[8 0]",
+        "[9 0],[0 0],[3 0],[8 0]"
+    };
+    const int requests[] = {0,1,2,3,4,0,5,0,6,7,3,8,9};
+    const int numRequests = 13;
+    BM_2QParams params = { .inPercent = 25, .outPercent = 50 };
+
+    BM_BufferPool *bm = MAKE_POOL();
+    testName = "Testing 2Q ghost hits";
+
+    createDummyPages(bm, 10);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 4, RS_2Q, &params));
+
+    runRequests(bm, requests, poolContents, numRequests);
+
+    ASSERT_EQUALS_INT(0, getNumWriteIO(bm), "check number of write I/Os");
+    ASSERT_EQUALS_INT(12, getNumReadIO(bm), "check number of read I/Os");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    TEST_DONE();
+}
+
+// shrinking moves pinned pages out of the frames being removed, keeping
+// their contents and dirty flags, and fails if there are more pinned pages
+// than frames left
+void
+testShrinkPinned (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle handles[4];
+    int i;
+    testName = "Testing shrinking a pool with pinned pages";
+
+    createDummyPages(bm, 10);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 4, RS_LRU, NULL));
+
+    for (i = 0; i < 4; i++)
+        CHECK(pinPage(bm, &handles[i], i));
+    for (i = 2; i < 4; i++)
+    {
+        sprintf(handles[i].data, "%s-%i", "Changed", i);
+        CHECK(markDirty(bm, &handles[i]));
+    }
+    CHECK(unpinPage(bm, &handles[0]));
+    CHECK(unpinPage(bm, &handles[1]));
+    ASSERT_EQUALS_POOL("[0 0],[1 0],[2x1],[3x1]", bm, "pages 2 and 3 pinned and dirty");
+
+    // pages 2 and 3 move into the two frames that are left
+    CHECK(resizeBufferPool(bm, 2));
+    ASSERT_EQUALS_INT(2, bm->numPages, "pool has two frames");
+    ASSERT_EQUALS_POOL("[2x1],[3x1]", bm, "pinned pages relocated with their dirty flags");
+    ASSERT_EQUALS_STRING("Changed-2", handles[2].data, "handle still sees page 2");
+    ASSERT_EQUALS_STRING("Changed-3", handles[3].data, "handle still sees page 3");
+
+    // two pinned pages do not fit into one frame
+    ASSERT_EQUALS_INT(RC_BUFFER_POOL_FULL, resizeBufferPool(bm, 1), "cannot shrink below the pinned pages");
+    ASSERT_EQUALS_POOL("[2x1],[3x1]", bm, "failed shrink changes nothing");
+
+    // once unpinned the dirty pages are written back before their frame goes
+    CHECK(unpinPage(bm, &handles[2]));
+    CHECK(unpinPage(bm, &handles[3]));
+    CHECK(resizeBufferPool(bm, 1));
+    ASSERT_EQUALS_INT(1, bm->numPages, "pool has one frame");
+    ASSERT_EQUALS_INT(2, getNumWriteIO(bm), "both dirty pages written");
+    CHECK(shutdownBufferPool(bm));
+
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+    for (i = 2; i < 4; i++)
+    {
+        char expected[32];
+        sprintf(expected, "%s-%i", "Changed", i);
+        CHECK(pinPage(bm, h, i));
+        ASSERT_EQUALS_STRING(expected, h->data, "changes reached the page file");
+        CHECK(unpinPage(bm, h));
+    }
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// two files attached to one shared pool: each handle sees the pool's
+// current size and its own pages, and detaching one file writes back and
+// drops its pages without touching the other file's pinned page
+void
+testSharedPoolDetach (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_BufferPool *other = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle *pinned = MAKE_PAGE_HANDLE();
+    BM_PoolConfig config = { .maxPages = 6 };
+    testName = "Testing detaching a file from the shared pool";
+
+    createDummyPages(bm, 10);
+    CHECK(createPageFile("testbuffer2.bin"));
+    CHECK(initSharedBufferPool(4, RS_LRU, NULL, &config));
+    CHECK(attachBufferPool(bm, "testbuffer.bin"));
+    CHECK(attachBufferPool(other, "testbuffer2.bin"));
+
+    CHECK(pinPage(bm, pinned, 0));
+    sprintf(pinned->data, "%s", "Pinned-0");
+    CHECK(markDirty(bm, pinned));
+    CHECK(pinPage(other, h, 0));
+    sprintf(h->data, "%s", "Other-0");
+    CHECK(markDirty(other, h));
+    CHECK(unpinPage(other, h));
+    CHECK(pinPage(other, h, 1));
+    CHECK(unpinPage(other, h));
+    ASSERT_EQUALS_POOL("[0x1],[-1 0],[-1 0],[-1 0]", bm, "first file sees its pinned page");
+    ASSERT_EQUALS_POOL("[-1 0],[0x0],[1 0],[-1 0]", other, "second file sees its two pages");
+    ASSERT_EQUALS_INT(1, getNumResidentPages(bm), "first file has one resident page");
+    ASSERT_EQUALS_INT(2, getNumResidentPages(other), "second file has two");
+    ASSERT_EQUALS_INT(3, getNumResidentPages(getSharedBufferPool()), "the pool holds three");
+
+    // a resize through one handle shows in the other
+    CHECK(resizeBufferPool(other, 6));
+    ASSERT_EQUALS_POOL("[0x1],[-1 0],[-1 0],[-1 0],[-1 0],[-1 0]", bm, "first file sees the new size");
+    ASSERT_EQUALS_INT(6, bm->numPages, "numPages follows the pool");
+
+    // detaching the second file leaves the first one's page alone
+    CHECK(shutdownBufferPool(other));
+    ASSERT_EQUALS_POOL("[0x1],[-1 0],[-1 0],[-1 0],[-1 0],[-1 0]", bm, "pinned page of the first file stays");
+    ASSERT_EQUALS_STRING("Pinned-0", pinned->data, "pinned page keeps its contents");
+    BM_PoolStats stats;
+    CHECK(getPoolStats(getSharedBufferPool(), &stats));
+    ASSERT_EQUALS_INT(1, stats.residentPages, "the detached file's pages are gone");
+    ASSERT_EQUALS_INT(1, getNumResidentPages(getSharedBufferPool()), "resident count follows the detach");
+    CHECK(unpinPage(bm, pinned));
+
+    // the second file's change was written back when it was detached
+    CHECK(attachBufferPool(other, "testbuffer2.bin"));
+    CHECK(pinPage(other, h, 0));
+    ASSERT_EQUALS_STRING("Other-0", h->data, "detach wrote the dirty page");
+    CHECK(unpinPage(other, h));
+    CHECK(shutdownBufferPool(other));
+    CHECK(shutdownBufferPool(bm));
+    CHECK(shutdownSharedBufferPool());
+
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+    CHECK(pinPage(bm, h, 0));
+    ASSERT_EQUALS_STRING("Pinned-0", h->data, "the first file's change was written too");
+    CHECK(unpinPage(bm, h));
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+    CHECK(destroyPageFile("testbuffer2.bin"));
+
+    free(bm);
+    free(other);
+    free(h);
+    free(pinned);
+    TEST_DONE();
+}
+
+// test that an exclusive latch taken and released after an optimistic
+// read started makes the read fail validation
+void
+testOptimisticReadAfterLatch (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle *reader = MAKE_PAGE_HANDLE();
+    uint64_t version;
+    testName = "Testing optimistic reads against exclusive latches";
+
+    createDummyPages(bm, 3);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+    ASSERT_ERROR(startOptimisticRead(bm, reader, 0, &version), "page not resident yet");
+    CHECK(pinPage(bm, h, 0));
+    CHECK(unpinPage(bm, h));
+
+    // nothing happened in between
+    CHECK(startOptimisticRead(bm, reader, 0, &version));
+    ASSERT_EQUALS_STRING("Page-0", reader->data, "optimistic read sees the page");
+    ASSERT_TRUE(validateOptimisticRead(bm, reader, version), "untouched page validates");
+
+    // a writer latched the page meanwhile
+    CHECK(startOptimisticRead(bm, reader, 0, &version));
+    CHECK(pinPageLatched(bm, h, 0, BM_LATCH_EXCLUSIVE));
+    ASSERT_ERROR(startOptimisticRead(bm, reader, 0, &version), "latched page is busy");
+    sprintf(h->data, "%s", "Changed-0");
+    CHECK(markDirty(bm, h));
+    CHECK(unpinPage(bm, h));
+    ASSERT_TRUE(!validateOptimisticRead(bm, reader, version), "read across a writer fails");
+
+    // a shared latch does not change the version
+    CHECK(startOptimisticRead(bm, reader, 0, &version));
+    CHECK(pinPageLatched(bm, h, 0, BM_LATCH_SHARED));
+    CHECK(unpinPage(bm, h));
+    ASSERT_TRUE(validateOptimisticRead(bm, reader, version), "read across a reader validates");
+    ASSERT_EQUALS_STRING("Changed-0", reader->data, "optimistic read sees the change");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    free(reader);
+    TEST_DONE();
+}
+
+// test that pinPages keeps nothing pinned when it fails part way
+void
+testPinPagesPartialFailure (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle handles[3];
+    PageNumber tooMany[] = { 1, 2, 3 };
+    PageNumber fits[] = { 1, 2 };
+    testName = "Testing pinPages releasing its pins on failure";
+
+    createDummyPages(bm, 5);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+    CHECK(pinPage(bm, h, 0));
+
+    // two frames are free for three pages
+    ASSERT_ERROR(pinPages(bm, handles, tooMany, 3), "three pages do not fit next to a pinned one");
+    int *fixCounts = getFixCounts(bm);
+    ASSERT_EQUALS_INT(1, fixCounts[0] + fixCounts[1] + fixCounts[2], "only the single pin is left");
+    free(fixCounts);
+
+    // the frames the failed call used are free again
+    CHECK(pinPages(bm, handles, fits, 2));
+    ASSERT_EQUALS_STRING("Page-1", handles[0].data, "first page of the batch");
+    ASSERT_EQUALS_STRING("Page-2", handles[1].data, "second page of the batch");
+    CHECK(unpinPage(bm, &handles[0]));
+    CHECK(unpinPage(bm, &handles[1]));
+    CHECK(unpinPage(bm, h));
+    ASSERT_EQUALS_POOL("[0 0],[1 0],[2 0]", bm, "all pins released");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// test that pages removed from the page table under collisions
+// (backward-shift deletion) leave every other resident page reachable
+void
+testPageTableCollisions (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle *probe = MAKE_PAGE_HANDLE();
+    uint64_t version;
+    unsigned int seed = 7;
+    int lost = 0, stale = 0, runs = 0;
+    testName = "Testing page table deletion under collisions";
+
+    createDummyPages(bm, 64);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 8, RS_FIFO, NULL));
+    PageIndex *ix = &((BM_MgmtData *)bm->mgmtData)->shards[0].pageTable;
+
+    for (int i = 0; i < 500; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        CHECK(pinPage(bm, h, (seed >> 16) % 64));
+        CHECK(unpinPage(bm, h));
+
+        // every resident page is found in its own frame, nothing else is found
+        PageNumber *contents = getFrameContents(bm);
+        int resident = 0;
+        for (int f = 0; f < 8; f++)
+        {
+            if (contents[f] == NO_PAGE)
+                continue;
+            resident++;
+            if (startOptimisticRead(bm, probe, contents[f], &version) != RC_OK || probe->frame != f)
+                lost++;
+        }
+        for (int p = 0; p < 64; p++)
+        {
+            bool inPool = false;
+            for (int f = 0; f < 8; f++)
+                inPool = inPool || contents[f] == p;
+            if (!inPool && startOptimisticRead(bm, probe, p, &version) == RC_OK)
+                stale++;
+        }
+        free(contents);
+
+        // count steps where two used slots sit side by side, i.e. a probe
+        // chain the deletion had to shift
+        int used = 0;
+        bool chained = false;
+        for (int s = 0; s <= ix->mask; s++)
+        {
+            if (ix->slots[s] == -1)
+                continue;
+            used++;
+            chained = chained || ix->slots[(s + 1) & ix->mask] != -1;
+        }
+        if (used != resident)
+            lost++;
+        if (chained)
+            runs++;
+    }
+    ASSERT_EQUALS_INT(0, lost, "every resident page is found in its frame");
+    ASSERT_EQUALS_INT(0, stale, "evicted pages are gone from the page table");
+    ASSERT_TRUE(runs > 100, "deletions happened next to other entries");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    free(probe);
+    TEST_DONE();
+}
+
+// test that a handle whose frame got another page since is rejected
+// rather than unpinning or dirtying that page
+void
+testStaleHandle (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle *stale = MAKE_PAGE_HANDLE();
+    BM_PageHandle *other = MAKE_PAGE_HANDLE();
+    testName = "Testing stale page handles";
+
+    createDummyPages(bm, 5);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+    CHECK(pinPage(bm, stale, 0));
+    CHECK(unpinPage(bm, stale));
+    CHECK(pinPage(bm, h, 1));
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPage(bm, h, 2));
+    CHECK(unpinPage(bm, h));
+
+    // page 3 takes page 0's frame and stays pinned
+    CHECK(pinPage(bm, other, 3));
+    ASSERT_EQUALS_INT(stale->frame, other->frame, "page 3 reuses page 0's frame");
+    ASSERT_EQUALS_POOL("[3 1],[1 0],[2 0]", bm, "page 3 pinned in frame 0");
+
+    ASSERT_ERROR(unpinPage(bm, stale), "unpin through the stale handle");
+    ASSERT_ERROR(markDirty(bm, stale), "markDirty through the stale handle");
+    ASSERT_ERROR(forcePage(bm, stale), "forcePage through the stale handle");
+    ASSERT_EQUALS_POOL("[3 1],[1 0],[2 0]", bm, "page 3 keeps its pin and stays clean");
+    ASSERT_EQUALS_STRING("Page-3", other->data, "page 3's data is untouched");
+
+    // once page 0 is back, in another frame, the stale handle finds it
+    // through the page table
+    CHECK(unpinPage(bm, other));
+    CHECK(pinPage(bm, h, 0));
+    ASSERT_TRUE(h->frame != stale->frame, "page 0 comes back in another frame");
+    CHECK(unpinPage(bm, stale));
+    ASSERT_EQUALS_POOL("[3 0],[0 0],[2 0]", bm, "the stale handle unpinned page 0");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    free(stale);
+    free(other);
+    TEST_DONE();
+}
+
+// Worker of testConcurrentPins: random pins over the whole page space,
+// each one checked against the page number the page carries. Every tenth
+// pin rewrites the page unchanged and marks it dirty.
+#define STRESS_THREADS 4
+#define STRESS_PAGES 64
+#define STRESS_PINS 20000
+
+typedef struct StressArgs {
+    BM_BufferPool *bm;
+    unsigned int seed;
+    int errors;
+    int wrongPages;
+    bool touched[STRESS_PAGES];
+} StressArgs;
+
+static void *
+stressPins (void *arg)
+{
+    StressArgs *a = arg;
+    BM_PageHandle h;
+    char expected[16];
+
+    for (int i = 0; i < STRESS_PINS; i++)
+    {
+        a->seed = a->seed * 1103515245 + 12345;
+        int page = (a->seed >> 16) % STRESS_PAGES;
+        if (pinPage(a->bm, &h, page) != RC_OK)
+        {
+            a->errors++;
+            continue;
+        }
+        sprintf(expected, "%s-%i", "Page", page);
+        if (h.pageNum != page || strcmp(h.data, expected) != 0)
+            a->wrongPages++;
+        if (i % 10 == 0)
+        {
+            sprintf(h.data, "%s", expected);
+            if (markDirty(a->bm, &h) != RC_OK)
+                a->errors++;
+        }
+        if (unpinPage(a->bm, &h) != RC_OK)
+            a->errors++;
+        a->touched[page] = true;
+    }
+    return NULL;
+}
+
+// test several threads pinning through a sharded pool smaller than the
+// page space: pins see their own page, no pin is lost or left behind, no
+// page is resident twice and the dirty pages reach the file intact
+void
+testConcurrentPins (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PoolConfig config = { .concurrent = true, .numShards = 2 };
+    pthread_t threads[STRESS_THREADS];
+    StressArgs args[STRESS_THREADS];
+    int errors = 0, wrongPages = 0, distinct = 0;
+    testName = "Testing concurrent pins on a sharded pool";
+
+    createDummyPages(bm, STRESS_PAGES);
+    CHECK(initBufferPoolWithConfig(bm, "testbuffer.bin", 16, RS_CLOCK, NULL, &config));
+    for (int t = 0; t < STRESS_THREADS; t++)
+    {
+        memset(&args[t], 0, sizeof(StressArgs));
+        args[t].bm = bm;
+        args[t].seed = 1000 + t;
+        pthread_create(&threads[t], NULL, stressPins, &args[t]);
+    }
+    for (int t = 0; t < STRESS_THREADS; t++)
+        pthread_join(threads[t], NULL);
+
+    for (int p = 0; p < STRESS_PAGES; p++)
+    {
+        bool touched = false;
+        for (int t = 0; t < STRESS_THREADS; t++)
+            touched = touched || args[t].touched[p];
+        distinct += touched;
+    }
+    for (int t = 0; t < STRESS_THREADS; t++)
+    {
+        errors += args[t].errors;
+        wrongPages += args[t].wrongPages;
+    }
+    ASSERT_EQUALS_INT(0, errors, "every pin, markDirty and unpin succeeded");
+    ASSERT_EQUALS_INT(0, wrongPages, "every pin saw its own page");
+
+    int *fixCounts = getFixCounts(bm);
+    PageNumber *contents = getFrameContents(bm);
+    int pinned = 0, duplicates = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        pinned += fixCounts[i];
+        for (int j = 0; j < i; j++)
+            duplicates += contents[i] != NO_PAGE && contents[i] == contents[j];
+    }
+    free(fixCounts);
+    free(contents);
+    ASSERT_EQUALS_INT(0, pinned, "all fix counts are 0 after the joins");
+    ASSERT_EQUALS_INT(0, duplicates, "no page is resident twice");
+    ASSERT_TRUE(getNumReadIO(bm) >= distinct, "every distinct page was read at least once");
+    CHECK(shutdownBufferPool(bm));
+
+    SM_FileHandle fh;
+    SM_PageHandle data = malloc(PAGE_SIZE);
+    char expected[16];
+    int wrongOnDisk = 0;
+    CHECK(openPageFile("testbuffer.bin", &fh));
+    for (int p = 0; p < STRESS_PAGES; p++)
+    {
+        CHECK(readBlock(p, &fh, data));
+        sprintf(expected, "%s-%i", "Page", p);
+        wrongOnDisk += strcmp(data, expected) != 0;
+    }
+    CHECK(closePageFile(&fh));
+    ASSERT_EQUALS_INT(0, wrongOnDisk, "written pages still carry their numbers");
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(data);
+    free(bm);
+    TEST_DONE();
+}
+
+// test LRU on a pool of more than 64 frames: the pinned oldest page is
+// skipped, a re-used page moves to the front and the remaining frames
+// are evicted in the order their pages were last unpinned
+void
+testLRUWidePool (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle *pinned = MAKE_PAGE_HANDLE();
+    PageNumber *contents;
+    int i, wrongVictims = 0;
+    testName = "Testing LRU on a pool of 70 frames";
+
+    createDummyPages(bm, 150);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 70, RS_LRU, NULL));
+
+    // page 0 stays pinned, pages 1 to 69 go on the list in order
+    CHECK(pinPage(bm, pinned, 0));
+    for (i = 1; i < 70; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+    // page 1 becomes the most recently used
+    CHECK(pinPage(bm, h, 1));
+    CHECK(unpinPage(bm, h));
+
+    // the pinned page 0 is older but is passed over for page 2
+    CHECK(pinPage(bm, h, 70));
+    CHECK(unpinPage(bm, h));
+    contents = getFrameContents(bm);
+    ASSERT_EQUALS_INT(0, contents[0], "pinned page 0 is not evicted");
+    ASSERT_EQUALS_INT(70, contents[2], "page 2 is the least recently used unpinned page");
+    free(contents);
+
+    // once unpinned page 0 is the most recent of all: pages 3 to 69 go
+    // first, then 1, 70 and 0 in the order they were used
+    CHECK(unpinPage(bm, pinned));
+    for (i = 3; i < 70; i++)
+    {
+        CHECK(pinPage(bm, h, 68 + i));
+        CHECK(unpinPage(bm, h));
+        contents = getFrameContents(bm);
+        wrongVictims += contents[i] != 68 + i;
+        free(contents);
+    }
+    ASSERT_EQUALS_INT(0, wrongVictims, "pages 3 to 69 are evicted in LRU order");
+
+    CHECK(pinPage(bm, h, 138));
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPage(bm, h, 139));
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPage(bm, h, 140));
+    CHECK(unpinPage(bm, h));
+    contents = getFrameContents(bm);
+    ASSERT_EQUALS_INT(138, contents[1], "page 1 goes after the scanned pages");
+    ASSERT_EQUALS_INT(139, contents[2], "then page 70");
+    ASSERT_EQUALS_INT(140, contents[0], "and page 0 last");
+    free(contents);
+
+    ASSERT_EQUALS_INT(0, getNumWriteIO(bm), "check number of write I/Os");
+    ASSERT_EQUALS_INT(141, getNumReadIO(bm), "check number of read I/Os");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    free(pinned);
+    TEST_DONE();
+}
+
+// test CLOCK on a pool of 70 frames, whose reference bits span two words:
+// the hand clears the bits of the first word and takes the first frame of
+// the second, and a pinned frame there keeps its bit and is passed over
+void
+testClockWordBoundary (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle *pinned = MAKE_PAGE_HANDLE();
+    PageNumber *contents;
+    int i;
+    testName = "Testing CLOCK across the 64-frame word boundary";
+
+    createDummyPages(bm, 80);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 70, RS_CLOCK, NULL));
+
+    for (i = 0; i < 70; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+    // every frame is referenced, so one full sweep clears all bits and the
+    // hand comes back to frame 0
+    CHECK(pinPage(bm, h, 70));
+    CHECK(unpinPage(bm, h));
+    contents = getFrameContents(bm);
+    ASSERT_EQUALS_INT(70, contents[0], "frame 0 is the victim after a full sweep");
+    free(contents);
+
+    // reference the rest of the first word and pin page 65
+    for (i = 1; i < 64; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+    CHECK(pinPage(bm, pinned, 65));
+
+    CHECK(pinPage(bm, h, 71));
+    CHECK(unpinPage(bm, h));
+    contents = getFrameContents(bm);
+    ASSERT_EQUALS_INT(71, contents[64], "first frame of the second word is the victim");
+    ASSERT_EQUALS_INT(1, contents[1], "referenced frames of the first word stay");
+    free(contents);
+
+    CHECK(pinPage(bm, h, 72));
+    CHECK(unpinPage(bm, h));
+    contents = getFrameContents(bm);
+    ASSERT_EQUALS_INT(65, contents[65], "pinned frame is passed over");
+    ASSERT_EQUALS_INT(72, contents[66], "the frame after it is the victim");
+    free(contents);
+
+    // the rest of the second word, then the hand wraps: frame 0 was loaded
+    // with its bit set, frame 1 lost its bit on the sweep to frame 64
+    CHECK(unpinPage(bm, pinned));
+    for (i = 73; i < 77; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+    contents = getFrameContents(bm);
+    ASSERT_EQUALS_INT(73, contents[67], "frame 67 is next");
+    ASSERT_EQUALS_INT(75, contents[69], "the hand reaches the last frame");
+    ASSERT_EQUALS_INT(70, contents[0], "frame 0 keeps its page on the wrap");
+    ASSERT_EQUALS_INT(76, contents[1], "frame 1 is the victim after the wrap");
+    ASSERT_EQUALS_INT(65, contents[65], "page 65 is still resident");
+    free(contents);
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    free(pinned);
+    TEST_DONE();
+}
+
+// test TinyLFU admission: a page leaving the window that was only touched
+// once loses to a hotter victim and is dropped, a window page used more
+// often than the victim is admitted in its place, and the sketch halves
+// its counters after sampleSize additions
+void
+testAdmission (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PoolConfig config = { .admission = true, .windowPercent = 10 };
+    FreqSketch *sk;
+    int i, round, sum, max;
+    testName = "Testing TinyLFU admission";
+
+    createDummyPages(bm, 110);
+
+    // nine main frames and a one-frame window
+    CHECK(initBufferPoolWithConfig(bm, "testbuffer.bin", 10, RS_LRU, NULL, &config));
+    ASSERT_EQUALS_INT(4 * 64, getAdmissionSketchBytes(bm), "four rows of the minimum width 64");
+
+    // pages 0 to 8 pass through the window into the empty main frames and
+    // are pinned four times each
+    for (round = 0; round < 4; round++)
+        for (i = 0; i < (round == 0 ? 10 : 9); i++)
+        {
+            CHECK(pinPage(bm, h, i));
+            CHECK(unpinPage(bm, h));
+        }
+    ASSERT_EQUALS_POOL("[0 0],[1 0],[2 0],[3 0],[4 0],[5 0],[6 0],[7 0],[8 0],[9 0]", bm,
+                       "window holds page 9");
+    ASSERT_EQUALS_INT(0, getNumAdmissionRejects(bm), "empty frames admit everything");
+
+    // one-touch pages leaving the window lose to the hot LRU victim
+    CHECK(pinPage(bm, h, 100));
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPage(bm, h, 101));
+    CHECK(unpinPage(bm, h));
+    ASSERT_EQUALS_POOL("[0 0],[1 0],[2 0],[3 0],[4 0],[5 0],[6 0],[7 0],[8 0],[101 0]", bm,
+                       "pages 9 and 100 are not admitted");
+    ASSERT_EQUALS_INT(2, getNumAdmissionRejects(bm), "two admissions rejected");
+
+    // page 101 becomes hotter than page 0, the LRU victim
+    for (i = 0; i < 5; i++)
+    {
+        CHECK(pinPage(bm, h, 101));
+        CHECK(unpinPage(bm, h));
+    }
+    CHECK(pinPage(bm, h, 102));
+    CHECK(unpinPage(bm, h));
+    ASSERT_EQUALS_POOL("[101 0],[1 0],[2 0],[3 0],[4 0],[5 0],[6 0],[7 0],[8 0],[102 0]", bm,
+                       "page 101 replaces page 0");
+    ASSERT_EQUALS_INT(2, getNumAdmissionRejects(bm), "admission not counted as a reject");
+    ASSERT_EQUALS_INT(13, getNumReadIO(bm), "check number of read I/Os");
+    CHECK(shutdownBufferPool(bm));
+
+    // a sample of 10 * 10 additions: page 0 saturates its four counters,
+    // and the hundredth addition halves them
+    CHECK(initBufferPoolWithConfig(bm, "testbuffer.bin", 10, RS_LRU, NULL, &config));
+    sk = &((BM_MgmtData *)bm->mgmtData)->shards[0].sketch;
+    for (i = 0; i < 99; i++)
+    {
+        CHECK(pinPage(bm, h, 0));
+        CHECK(unpinPage(bm, h));
+    }
+    for (i = 0, sum = 0; i < 4 * 64; i++)
+        sum += sk->counters[i];
+    ASSERT_EQUALS_INT(4 * 15, sum, "four saturated counters before the halving");
+    ASSERT_EQUALS_INT(99, sk->additions, "99 additions counted");
+
+    CHECK(pinPage(bm, h, 0));
+    CHECK(unpinPage(bm, h));
+    for (i = 0, sum = 0, max = 0; i < 4 * 64; i++)
+    {
+        sum += sk->counters[i];
+        if (sk->counters[i] > max) max = sk->counters[i];
+    }
+    ASSERT_EQUALS_INT(4 * 7, sum, "counters halved");
+    ASSERT_EQUALS_INT(7, max, "no counter above half the maximum");
+    ASSERT_EQUALS_INT(50, sk->additions, "addition count halved");
+    CHECK(shutdownBufferPool(bm));
+
+    // the width follows the pool size: 200 frames round up to 256
+    config.windowPercent = 0;
+    CHECK(initBufferPoolWithConfig(bm, "testbuffer.bin", 200, RS_LRU, NULL, &config));
+    ASSERT_EQUALS_INT(4 * 256, getAdmissionSketchBytes(bm), "four rows of width 256");
+    CHECK(shutdownBufferPool(bm));
+    config.admission = false;
+    CHECK(initBufferPoolWithConfig(bm, "testbuffer.bin", 200, RS_LRU, NULL, &config));
+    ASSERT_EQUALS_INT(0, getAdmissionSketchBytes(bm), "no sketch without admission");
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// Number of dirty frames in the pool.
+static int
+countDirty (BM_BufferPool *bm)
+{
+    bool *flags = getDirtyFlags(bm);
+    int dirty = 0;
+    for (int i = 0; i < bm->numPages; i++)
+        dirty += flags[i];
+    free(flags);
+    return dirty;
+}
+
+// Wait up to five seconds for the background writer to bring the pool
+// down to dirty dirty frames.
+static bool
+waitForDirty (BM_BufferPool *bm, int dirty)
+{
+    struct timespec tick = { 0, 10 * 1000000L };
+    for (int i = 0; i < 500; i++)
+    {
+        if (countDirty(bm) == dirty)
+            return true;
+        nanosleep(&tick, NULL);
+    }
+    return false;
+}
+
+// Read a block through the pool's own file handle under its I/O latch, so
+// no write of the background writer is in flight or still buffered.
+static void
+readThroughPool (BM_BufferPool *bm, PageNumber pageNum, SM_PageHandle data)
+{
+    BM_MgmtData *mgmt = bm->mgmtData;
+    pthread_mutex_lock(&mgmt->ioLatch);
+    CHECK(readBlock(pageNum, &mgmt->files[0].fh, data));
+    pthread_mutex_unlock(&mgmt->ioLatch);
+}
+
+// test the background writer: crossing the watermark gets the unpinned
+// dirty frames written and cleaned but not the pinned one, a page changed
+// while its write is in flight is not marked clean, and shutdown stops the
+// writer and flushes what is left
+void
+testBackgroundWriter (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle *pinned = MAKE_PAGE_HANDLE();
+    BM_PoolConfig config = { .backgroundWriter = true, .dirtyWatermark = 10 };
+    SM_PageHandle data = malloc(PAGE_SIZE);
+    SM_FileHandle fh;
+    char expected[16];
+    int i, wrong, last;
+    testName = "Testing the background writer";
+
+    createDummyPages(bm, 10);
+    // the writer wakes above one dirty frame and cleans down to none
+    CHECK(initBufferPoolWithConfig(bm, "testbuffer.bin", 10, RS_FIFO, NULL, &config));
+
+    // dirty every page while all are pinned, then release all but page 0
+    CHECK(pinPage(bm, pinned, 0));
+    sprintf(pinned->data, "%s-%i", "Dirty", 0);
+    CHECK(markDirty(bm, pinned));
+    for (i = 1; i < 10; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        sprintf(h->data, "%s-%i", "Dirty", i);
+        CHECK(markDirty(bm, h));
+    }
+    for (i = 1; i < 10; i++)
+    {
+        h->pageNum = i;
+        CHECK(unpinPage(bm, h));
+    }
+
+    ASSERT_TRUE(waitForDirty(bm, 1), "writer cleans the unpinned frames");
+    bool *flags = getDirtyFlags(bm);
+    ASSERT_TRUE(flags[0], "pinned page 0 stays dirty");
+    free(flags);
+    ASSERT_EQUALS_INT(9, getNumWriteIO(bm), "each unpinned page written once");
+    for (i = 0, wrong = 0; i < 10; i++)
+    {
+        readThroughPool(bm, i, data);
+        sprintf(expected, "%s-%i", i == 0 ? "Page" : "Dirty", i);
+        wrong += strcmp(data, expected) != 0;
+    }
+    ASSERT_EQUALS_INT(0, wrong, "pages 1 to 9 are on disk, page 0 is not");
+
+    // keep changing page 1, pausing after each change so the writer finds
+    // it unpinned, until the writer has written it a few hundred times:
+    // whenever the frame is clean the last change must be on disk
+    struct timespec pause = { 0, 1000 };
+    for (i = 0, wrong = 0; getNumWriteIO(bm) < 9 + 300 && i < 100000; i++)
+    {
+        Frame *f = &((BM_MgmtData *)bm->mgmtData)->shards[0].frames[1];
+        CHECK(pinPage(bm, h, 1));
+        sprintf(h->data, "%s-%i", "Update", i);
+        CHECK(markDirty(bm, h));
+        CHECK(unpinPage(bm, h));
+
+        BM_MgmtData *mgmt = bm->mgmtData;
+        pthread_mutex_lock(&mgmt->ioLatch);
+        if (!__atomic_load_n(&f->isDirty, __ATOMIC_ACQUIRE))
+        {
+            CHECK(readBlock(1, &mgmt->files[0].fh, data));
+            sprintf(expected, "%s-%i", "Update", i);
+            wrong += strcmp(data, expected) != 0;
+        }
+        pthread_mutex_unlock(&mgmt->ioLatch);
+        nanosleep(&pause, NULL);
+    }
+    ASSERT_EQUALS_INT(0, wrong, "a page changed during its write stays dirty");
+    last = i - 1;
+    ASSERT_TRUE(waitForDirty(bm, 1), "writer catches up with page 1");
+
+    // dirty a few more pages and shut down straight away
+    CHECK(unpinPage(bm, pinned));
+    for (i = 2; i < 6; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        sprintf(h->data, "%s-%i", "Last", i);
+        CHECK(markDirty(bm, h));
+        CHECK(unpinPage(bm, h));
+    }
+    CHECK(shutdownBufferPool(bm));
+
+    CHECK(openPageFile("testbuffer.bin", &fh));
+    for (i = 0, wrong = 0; i < 10; i++)
+    {
+        CHECK(readBlock(i, &fh, data));
+        if (i == 1)
+            sprintf(expected, "%s-%i", "Update", last);
+        else
+            sprintf(expected, "%s-%i", i >= 2 && i < 6 ? "Last" : "Dirty", i);
+        wrong += strcmp(data, expected) != 0;
+    }
+    CHECK(closePageFile(&fh));
+    ASSERT_EQUALS_INT(0, wrong, "shutdown leaves every change on disk");
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(data);
+    free(bm);
+    free(h);
+    free(pinned);
+    TEST_DONE();
+}
+
+// Wait up to five seconds for the prefetcher to have read reads pages in
+// total and released them; stats is left with the pool's counters.
+static bool
+waitForPrefetch (BM_BufferPool *bm, int reads, BM_PoolStats *stats)
+{
+    struct timespec tick = { 0, 10 * 1000000L };
+    for (int i = 0; i < 500; i++)
+    {
+        CHECK(getPoolStats(bm, stats));
+        if (stats->readIO == reads && stats->pinnedPages == 0)
+            return true;
+        nanosleep(&tick, NULL);
+    }
+    return false;
+}
+
+// test prefetchPages: prefetched pages are resident but not pinned, a pin
+// of one is a hit, and the ones evicted without a pin count as wasted
+void
+testPrefetch (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PoolStats stats;
+    int i;
+    testName = "Testing prefetchPages";
+
+    createDummyPages(bm, 20);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 10, RS_FIFO, NULL));
+
+    CHECK(prefetchPages(bm, 0, 4));
+    ASSERT_TRUE(waitForPrefetch(bm, 4, &stats), "prefetcher reads pages 0 to 3");
+    ASSERT_EQUALS_POOL("[0 0],[1 0],[2 0],[3 0],[-1 0],[-1 0],[-1 0],[-1 0],[-1 0],[-1 0]", bm,
+                       "prefetched pages are resident with fix count 0");
+    ASSERT_EQUALS_INT(4, stats.residentPages, "four pages resident");
+    ASSERT_EQUALS_INT(0, stats.pinnedPages, "none of them pinned");
+    ASSERT_EQUALS_INT(0, (int)stats.misses, "prefetching is not a pin");
+
+    // resident pages are not read again, pages past the end are skipped
+    CHECK(prefetchPages(bm, 2, 2));
+    CHECK(prefetchPages(bm, 18, 10));
+    ASSERT_TRUE(waitForPrefetch(bm, 6, &stats), "only pages 18 and 19 are read");
+
+    CHECK(pinPage(bm, h, 2));
+    ASSERT_TRUE(strcmp(h->data, "Page-2") == 0, "prefetched page holds its data");
+    CHECK(unpinPage(bm, h));
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(1, (int)stats.hits, "pin of a prefetched page is a hit");
+    ASSERT_EQUALS_INT(0, (int)stats.misses, "and not a miss");
+    ASSERT_EQUALS_INT(1, getNumPrefetchHits(bm), "one prefetch hit");
+    ASSERT_EQUALS_INT(6, getNumReadIO(bm), "no read for the hit");
+
+    // a second pin of the same page is an ordinary hit
+    CHECK(pinPage(bm, h, 2));
+    CHECK(unpinPage(bm, h));
+    ASSERT_EQUALS_INT(1, getNumPrefetchHits(bm), "counted once per prefetched page");
+
+    // push every page out: 0, 1, 3, 18 and 19 were never pinned
+    for (i = 4; i < 14; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(5, getNumPrefetchWasted(bm), "five prefetched pages wasted");
+    ASSERT_EQUALS_INT(5, stats.prefetchWasted, "stats agree on wasted pages");
+    ASSERT_EQUALS_INT(1, stats.prefetchHits, "stats agree on prefetch hits");
+    ASSERT_EQUALS_INT(6, (int)stats.evictions[BM_EVICT_MISS], "six evictions by misses");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// test sequential read-ahead: the third consecutive pin starts a window of
+// four pages, the window doubles each time the pins reach the middle of
+// what was requested, a pin elsewhere halves it, and the read-ahead pages
+// show up as prefetch hits or, if never pinned, as wasted
+void
+testReadAhead (void)
+{
+    // pins 10 to 20 with the total reads and the window after each
+    const int reads[] = { 1, 2, 7, 7, 7, 14, 14, 14, 14, 14, 27 };
+    const int windows[] = { 0, 0, 4, 4, 4, 8, 8, 8, 8, 8, 16 };
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PoolConfig config = { .readAhead = true, .maxReadAhead = 16 };
+    BM_PoolStats stats;
+    int i, wrongReads = 0, wrongWindows = 0;
+    testName = "Testing sequential read-ahead";
+
+    createDummyPages(bm, 200);
+    CHECK(initBufferPoolWithConfig(bm, "testbuffer.bin", 64, RS_FIFO, NULL, &config));
+
+    for (i = 0; i < 11; i++)
+    {
+        CHECK(pinPage(bm, h, 10 + i));
+        CHECK(unpinPage(bm, h));
+        wrongReads += !waitForPrefetch(bm, reads[i], &stats);
+        wrongWindows += getReadAheadWindow(bm) != windows[i];
+    }
+    ASSERT_EQUALS_INT(0, wrongReads, "read-ahead requests 13-16, 17-23 and 24-36");
+    ASSERT_EQUALS_INT(0, wrongWindows, "window grows 4, 8, 16");
+    ASSERT_EQUALS_INT(3, (int)stats.misses, "only the first three pins miss");
+    ASSERT_EQUALS_INT(8, getNumPrefetchHits(bm), "pins of 13 to 20 are prefetch hits");
+
+    // a pin elsewhere halves the window and queues nothing
+    CHECK(pinPage(bm, h, 100));
+    CHECK(unpinPage(bm, h));
+    ASSERT_EQUALS_INT(8, getReadAheadWindow(bm), "random pin halves the window");
+    ASSERT_TRUE(waitForPrefetch(bm, 28, &stats), "no read-ahead after the random pin");
+
+    // non-consecutive pins push the pool out without starting a run: the
+    // read-ahead pages 21 to 36 were never pinned
+    for (i = 0; i < 64; i++)
+    {
+        CHECK(pinPage(bm, h, 39 + 2 * i));
+        CHECK(unpinPage(bm, h));
+    }
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(92, stats.readIO, "one read per non-consecutive pin");
+    ASSERT_EQUALS_INT(16, getNumPrefetchWasted(bm), "16 read-ahead pages wasted");
+    ASSERT_EQUALS_INT(16, stats.prefetchWasted, "stats agree on wasted pages");
+    ASSERT_EQUALS_INT(8, stats.prefetchHits, "stats agree on prefetch hits");
+    ASSERT_EQUALS_INT(0, getReadAheadWindow(bm), "window halved away");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// test access rings: a scan of a file larger than the pool through a
+// 16-frame ring keeps recycling its own frames and leaves the hot pages
+// resident, and a scan page someone else pins is not recycled
+void
+testAccessRing (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle *other = MAKE_PAGE_HANDLE();
+    BM_AccessRing ring;
+    BM_PoolStats stats;
+    PageNumber *contents;
+    char expected[16];
+    int i, wrongData = 0, hot = 0, scanned = 0;
+    testName = "Testing scans through an access ring";
+
+    createDummyPages(bm, 300);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 64, RS_LRU, NULL));
+
+    for (i = 0; i < 32; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+
+    CHECK(initAccessRing(bm, &ring, 16));
+    ASSERT_EQUALS_INT(16, ring.numFrames, "ring of 16 frames");
+    for (i = 100; i < 300; i++)
+    {
+        CHECK(pinPageWithRing(bm, h, i, &ring));
+        sprintf(expected, "%s-%i", "Page", i);
+        wrongData += strcmp(h->data, expected) != 0;
+        CHECK(unpinPage(bm, h));
+        // page 150 is pinned again outside the scan and held
+        if (i == 150)
+            CHECK(pinPage(bm, other, 150));
+    }
+    CHECK(freeAccessRing(&ring));
+    ASSERT_EQUALS_INT(0, wrongData, "every scanned page holds its data");
+
+    contents = getFrameContents(bm);
+    for (i = 0; i < 64; i++)
+    {
+        hot += contents[i] >= 0 && contents[i] < 32;
+        scanned += contents[i] >= 100;
+    }
+    free(contents);
+    ASSERT_EQUALS_INT(32, hot, "hot pages are all still resident");
+    ASSERT_EQUALS_INT(17, scanned, "the ring's 16 frames and the frame of page 150");
+
+    // the first 16 scan misses took empty frames, every other miss but
+    // the one that would have taken page 150's frame recycled a ring frame
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(183, (int)stats.evictions[BM_EVICT_RING], "ring frames are recycled");
+    ASSERT_EQUALS_INT(0, (int)stats.evictions[BM_EVICT_MISS], "no page evicted by the strategy");
+    ASSERT_EQUALS_INT(232, stats.readIO, "one read per page");
+    ASSERT_EQUALS_INT(1, stats.pinnedPages, "page 150 is still pinned");
+    ASSERT_TRUE(strcmp(other->data, "Page-150") == 0, "and still holds its data");
+
+    CHECK(unpinPage(bm, other));
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    free(other);
+    TEST_DONE();
+}
+
+// Number of frames in use whose data is not a page-aligned arena block of
+// its own, or does not hold "Page-n" for its page n (pages in skip aside).
+static int
+checkFrameBlocks (BM_BufferPool *bm, PageNumber skip1, PageNumber skip2)
+{
+    BM_MgmtData *mgmt = bm->mgmtData;
+    bool *used = calloc(mgmt->maxPages, sizeof(bool));
+    char expected[16];
+    int wrong = 0;
+
+    for (int s = 0; s < mgmt->numShards; s++)
+    {
+        BM_Shard *sh = &mgmt->shards[s];
+        for (int i = 0; i < sh->numFrames; i++)
+        {
+            Frame *f = &sh->frames[i];
+            long offset = f->data - mgmt->arena;
+            if ((uintptr_t)f->data % PAGE_SIZE != 0 || offset < 0 ||
+                offset >= (long)mgmt->maxPages * PAGE_SIZE || used[offset / PAGE_SIZE])
+            {
+                wrong++;
+                continue;
+            }
+            used[offset / PAGE_SIZE] = true;
+            sprintf(expected, "%s-%i", "Page", f->pageNum);
+            if (f->pageNum != NO_PAGE && f->pageNum != skip1 && f->pageNum != skip2)
+                wrong += strcmp(f->data, expected) != 0;
+        }
+    }
+    free(used);
+    return wrong;
+}
+
+// test that frame data stays page-aligned across resizes and that a page
+// moved to another frame by a shrink keeps its block and with it its
+// latch word, held exclusive or shared
+void
+testResizeAlignment (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle *writer = MAKE_PAGE_HANDLE();
+    BM_PageHandle *reader = MAKE_PAGE_HANDLE();
+    BM_PoolConfig config = { .maxPages = 64 };
+    BM_MgmtData *mgmt;
+    char *writerData, *readerData;
+    uint64_t *word;
+    int i, moved;
+    testName = "Testing frame alignment and page latches across resizes";
+
+    createDummyPages(bm, 40);
+    CHECK(initBufferPoolWithConfig(bm, "testbuffer.bin", 8, RS_FIFO, NULL, &config));
+    mgmt = bm->mgmtData;
+    ASSERT_TRUE((uintptr_t)mgmt->arena % PAGE_SIZE == 0, "arena is page-aligned");
+
+    for (i = 0; i < 6; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+    // pages 6 and 7 land in the last two frames and stay latched
+    CHECK(pinPageLatched(bm, writer, 6, BM_LATCH_EXCLUSIVE));
+    sprintf(writer->data, "%s", "Changed-6");
+    CHECK(markDirty(bm, writer));
+    CHECK(pinPageLatched(bm, reader, 7, BM_LATCH_SHARED));
+    writerData = writer->data;
+    readerData = reader->data;
+    ASSERT_EQUALS_INT(0, checkFrameBlocks(bm, 6, NO_PAGE), "frames of the initial pool");
+
+    CHECK(resizeBufferPool(bm, 32));
+    for (i = 8; i < 32; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+    ASSERT_EQUALS_INT(0, checkFrameBlocks(bm, 6, NO_PAGE), "frames after growing to 32");
+
+    // frames 6 and 7 go away: their pages move with their blocks
+    CHECK(resizeBufferPool(bm, 4));
+    ASSERT_EQUALS_INT(0, checkFrameBlocks(bm, 6, NO_PAGE), "frames after shrinking to 4");
+    ASSERT_TRUE(writer->data == writerData && reader->data == readerData,
+                "handles still point at their pages");
+    ASSERT_TRUE(strcmp(writer->data, "Changed-6") == 0, "page 6 keeps its change");
+    ASSERT_TRUE(strcmp(reader->data, "Page-7") == 0, "page 7 keeps its data");
+
+    // the latch words of the blocks, not of the frames, are the ones held
+    word = &mgmt->pageLatches[(writerData - mgmt->arena) / PAGE_SIZE];
+    ASSERT_TRUE((*word & 1) != 0, "page 6 is still latched exclusive");
+    word = &mgmt->pageLatches[(readerData - mgmt->arena) / PAGE_SIZE];
+    ASSERT_EQUALS_INT(1, (int)((*word >> 2) & ((1 << 20) - 1)), "page 7 has one shared holder");
+    for (i = 0, moved = 0; i < mgmt->shards[0].numFrames; i++)
+    {
+        Frame *f = &mgmt->shards[0].frames[i];
+        moved += f->pageNum == 6 && f->data == writerData;
+        moved += f->pageNum == 7 && f->data == readerData;
+    }
+    ASSERT_EQUALS_INT(2, moved, "the frames of pages 6 and 7 use the latched blocks");
+
+    CHECK(unpinPage(bm, writer));
+    CHECK(unpinPage(bm, reader));
+    word = &mgmt->pageLatches[(writerData - mgmt->arena) / PAGE_SIZE];
+    ASSERT_TRUE((*word & 1) == 0, "unpin releases the exclusive latch");
+    CHECK(pinPageLatched(bm, reader, 6, BM_LATCH_SHARED));
+    ASSERT_TRUE(strcmp(reader->data, "Changed-6") == 0, "page 6 can be latched again");
+    CHECK(unpinPage(bm, reader));
+
+    CHECK(resizeBufferPool(bm, 16));
+    for (i = 32; i < 40; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+    ASSERT_EQUALS_INT(0, checkFrameBlocks(bm, 6, NO_PAGE), "frames after growing again");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    free(writer);
+    free(reader);
+    TEST_DONE();
+}
+
+// Replace the file at name with contents.
+static void
+writeTextFile (const char *name, const char *contents)
+{
+    FILE *fp = fopen(name, "w");
+    fputs(contents, fp);
+    fclose(fp);
+}
+
+// test warm restart: the list saved at shutdown brings back the same
+// pages, in the same recency order and with their data, and a missing or
+// damaged list is a cold start
+void
+testWarmRestart (void)
+{
+    const int requests[] = { 3, 7, 1, 9, 5, 3 };
+    const char *damaged[] = {
+        "5\n7\n1\n9\n",         // fewer pages than the count
+        "3\n7\n1\n9",           // last line cut off
+        "2\n7\n1\n9\n",         // more pages than the count
+        "3\n7\nx\n9\n",         // not a page number
+        "12"                    // no complete line at all
+    };
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PoolConfig config = { .warmFile = "testbuffer.warm" };
+    BM_PoolStats stats;
+    char saved[64];
+    size_t len;
+    FILE *fp;
+    int i;
+    testName = "Testing warm restart";
+
+    createDummyPages(bm, 30);
+    remove("testbuffer.warm");
+
+    // no list yet: a cold start
+    CHECK(initBufferPoolWithConfig(bm, "testbuffer.bin", 5, RS_LRU, NULL, &config));
+    ASSERT_EQUALS_POOL("[-1 0],[-1 0],[-1 0],[-1 0],[-1 0]", bm, "missing list is a cold start");
+    for (i = 0; i < 6; i++)
+    {
+        CHECK(pinPage(bm, h, requests[i]));
+        if (requests[i] == 9)
+        {
+            sprintf(h->data, "%s", "Changed-9");
+            CHECK(markDirty(bm, h));
+        }
+        CHECK(unpinPage(bm, h));
+    }
+    CHECK(shutdownBufferPool(bm));
+
+    fp = fopen("testbuffer.warm", "r");
+    ASSERT_TRUE(fp != NULL, "shutdown saves the list");
+    len = fread(saved, 1, sizeof(saved) - 1, fp);
+    saved[len] = '\0';
+    fclose(fp);
+    ASSERT_EQUALS_STRING("5\n7\n1\n9\n5\n3\n", saved, "count, then pages least recently used first");
+
+    // the pages come back in LRU order into the empty frames, read at init
+    CHECK(initBufferPoolWithConfig(bm, "testbuffer.bin", 5, RS_LRU, NULL, &config));
+    ASSERT_EQUALS_POOL("[7 0],[1 0],[9 0],[5 0],[3 0]", bm, "same resident set after the restart");
+    ASSERT_EQUALS_INT(5, getNumReadIO(bm), "pages read at init");
+
+    // misses evict the oldest first: 7, then 1
+    CHECK(pinPage(bm, h, 20));
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPage(bm, h, 21));
+    CHECK(unpinPage(bm, h));
+    ASSERT_EQUALS_POOL("[20 0],[21 0],[9 0],[5 0],[3 0]", bm, "recency order kept");
+
+    CHECK(pinPage(bm, h, 9));
+    ASSERT_EQUALS_STRING("Changed-9", h->data, "reloaded page 9 holds what was flushed");
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPage(bm, h, 5));
+    ASSERT_EQUALS_STRING("Page-5", h->data, "reloaded page 5 holds its data");
+    CHECK(unpinPage(bm, h));
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(2, (int)stats.hits, "reloaded pages are hits");
+    ASSERT_EQUALS_INT(2, (int)stats.misses, "only the new pages missed");
+    ASSERT_EQUALS_INT(0, (int)stats.evictions[BM_EVICT_RELOAD], "nothing displaced by the reload");
+    CHECK(shutdownBufferPool(bm));
+
+    // a damaged list is ignored
+    for (i = 0; i < 5; i++)
+    {
+        writeTextFile("testbuffer.warm", damaged[i]);
+        CHECK(initBufferPoolWithConfig(bm, "testbuffer.bin", 5, RS_LRU, NULL, &config));
+        ASSERT_EQUALS_POOL("[-1 0],[-1 0],[-1 0],[-1 0],[-1 0]", bm, "damaged list is a cold start");
+        ASSERT_EQUALS_INT(0, getNumReadIO(bm), "nothing read at init");
+        CHECK(shutdownBufferPool(bm));
+    }
+    remove("testbuffer.warm");
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// test that forceFlushPool writes the dirty unpinned pages in page order,
+// one write call per run of consecutive pages, and leaves a pinned dirty
+// page alone even where it would extend a run
+void
+testFlushCoalescing (void)
+{
+    const int dirtyPages[] = { 3, 1, 2, 7 };
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle *pinned = MAKE_PAGE_HANDLE();
+    SM_PageHandle data = malloc(PAGE_SIZE);
+    SM_FileHandle fh;
+    char expected[16];
+    int i, wrong;
+    testName = "Testing forceFlushPool write coalescing";
+
+    createDummyPages(bm, 10);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 8, RS_FIFO, NULL));
+
+    CHECK(pinPage(bm, h, 0));
+    CHECK(unpinPage(bm, h));
+    for (i = 0; i < 4; i++)
+    {
+        CHECK(pinPage(bm, h, dirtyPages[i]));
+        sprintf(h->data, "%s-%i", "Flushed", dirtyPages[i]);
+        CHECK(markDirty(bm, h));
+        CHECK(unpinPage(bm, h));
+    }
+    CHECK(pinPage(bm, pinned, 4));
+    sprintf(pinned->data, "%s-%i", "Pinned", 4);
+    CHECK(markDirty(bm, pinned));
+    CHECK(pinPage(bm, h, 5));
+    CHECK(unpinPage(bm, h));
+    ASSERT_EQUALS_POOL("[0 0],[3x0],[1x0],[2x0],[7x0],[4x1],[5 0],[-1 0]", bm, "dirty pages before the flush");
+
+    // pages 1 to 3 in one call, page 7 in another
+    CHECK(forceFlushPool(bm));
+    ASSERT_EQUALS_POOL("[0 0],[3 0],[1 0],[2 0],[7 0],[4x1],[5 0],[-1 0]", bm, "pinned page 4 stays dirty");
+    ASSERT_EQUALS_INT(4, getNumWriteIO(bm), "four pages written");
+    ASSERT_EQUALS_INT(2, getNumWritesSaved(bm), "two writes saved by the run 1-3");
+
+    CHECK(openPageFile("testbuffer.bin", &fh));
+    for (i = 0, wrong = 0; i < 10; i++)
+    {
+        CHECK(readBlock(i, &fh, data));
+        sprintf(expected, "%s-%i", (i >= 1 && i <= 3) || i == 7 ? "Flushed" : "Page", i);
+        wrong += strcmp(data, expected) != 0;
+    }
+    ASSERT_EQUALS_INT(0, wrong, "flushed pages on disk, page 4 and clean pages untouched");
+
+    // nothing left to do but page 4 once it is unpinned
+    CHECK(forceFlushPool(bm));
+    ASSERT_EQUALS_INT(4, getNumWriteIO(bm), "a second flush writes nothing");
+    CHECK(unpinPage(bm, pinned));
+    CHECK(forceFlushPool(bm));
+    ASSERT_EQUALS_INT(5, getNumWriteIO(bm), "page 4 written after the unpin");
+    ASSERT_EQUALS_INT(2, getNumWritesSaved(bm), "a single page saves nothing");
+    CHECK(readBlock(4, &fh, data));
+    ASSERT_EQUALS_STRING("Pinned-4", data, "page 4 on disk");
+    CHECK(closePageFile(&fh));
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(data);
+    free(bm);
+    free(h);
+    free(pinned);
+    TEST_DONE();
+}
+
+// test getPoolStats and sprintPoolStatsJSON on a known FIFO sequence:
+// exact hit, miss and eviction counts by reason, the JSON text, safe
+// truncation into a short buffer, and the latency histogram only being
+// kept with pinLatency set
+void
+testPoolStats (void)
+{
+    // hits on 0 and 3; 3 is dirty when 6 evicts it
+    const int requests[] = { 0, 1, 2, 0, 3, 4, 3, 5, 6 };
+    const char *expected =
+        "{\"strategy\":\"FIFO\",\"numPages\":2,\"residentPages\":2,\"dirtyPages\":0,\"pinnedPages\":1,"
+        "\"hits\":3,\"misses\":7,\"hitRatio\":0.3000,"
+        "\"evictions\":{\"miss\":4,\"prefetch\":0,\"ring\":0,\"resize\":1,\"detach\":0,\"reload\":0},"
+        "\"dirtyEvictions\":1,\"pinWaits\":0,\"pinWaitNanos\":0,"
+        "\"pinLatencyLog2Nanos\":[0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0],"
+        "\"readIO\":7,\"writeIO\":1,\"writesSaved\":0,\"writeErrors\":0,"
+        "\"prefetchHits\":0,\"prefetchWasted\":0,\"admissionRejects\":0}";
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PoolConfig config = { .pinLatency = true };
+    BM_PoolStats stats;
+    char json[1024], small[32];
+    uint64_t timed;
+    int i, len;
+    testName = "Testing pool statistics";
+
+    createDummyPages(bm, 10);
+    CHECK(initBufferPool(bm, "testbuffer.bin", 3, RS_FIFO, NULL));
+    for (i = 0; i < 9; i++)
+    {
+        CHECK(pinPage(bm, h, requests[i]));
+        if (requests[i] == 3)
+            CHECK(markDirty(bm, h));
+        CHECK(unpinPage(bm, h));
+    }
+    ASSERT_EQUALS_POOL("[6 0],[4 0],[5 0]", bm, "pool after the sequence");
+
+    // a hit held pinned, then a shrink that evicts page 5
+    CHECK(pinPage(bm, h, 4));
+    CHECK(resizeBufferPool(bm, 2));
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(2, stats.numPages, "two frames");
+    ASSERT_EQUALS_INT(2, stats.residentPages, "both resident");
+    ASSERT_EQUALS_INT(1, stats.pinnedPages, "page 4 pinned");
+    ASSERT_EQUALS_INT(3, (int)stats.hits, "hits on 0, 3 and 4");
+    ASSERT_EQUALS_INT(7, (int)stats.misses, "seven misses");
+    ASSERT_EQUALS_INT(4, (int)stats.evictions[BM_EVICT_MISS], "pages 0 to 3 evicted by misses");
+    ASSERT_EQUALS_INT(1, (int)stats.evictions[BM_EVICT_RESIZE], "page 5 evicted by the shrink");
+    ASSERT_EQUALS_INT(1, (int)stats.dirtyEvictions, "page 3 written on eviction");
+    ASSERT_EQUALS_INT(7, stats.readIO, "one read per miss");
+    ASSERT_EQUALS_INT(1, stats.writeIO, "one write");
+
+    len = sprintPoolStatsJSON(bm, json, sizeof(json));
+    ASSERT_EQUALS_STRING(expected, json, "JSON snapshot");
+    ASSERT_EQUALS_INT((int)strlen(expected), len, "returns the length");
+
+    // a short buffer gets a terminated prefix and nothing past its end
+    memset(small, '#', sizeof(small));
+    len = sprintPoolStatsJSON(bm, small, 16);
+    ASSERT_EQUALS_INT((int)strlen(expected), len, "still returns the full length");
+    ASSERT_TRUE(small[15] == '\0' && strncmp(small, expected, 15) == 0, "truncated to 15 characters");
+    ASSERT_TRUE(small[16] == '#', "nothing written past the buffer");
+    memset(small, '#', sizeof(small));
+    len = sprintPoolStatsJSON(bm, small, 0);
+    ASSERT_TRUE(len == (int)strlen(expected) && small[0] == '#', "size 0 writes nothing");
+
+    CHECK(unpinPage(bm, h));
+    CHECK(shutdownBufferPool(bm));
+
+    // with pinLatency every pin, hit or miss, lands in one bucket
+    CHECK(initBufferPoolWithConfig(bm, "testbuffer.bin", 3, RS_FIFO, NULL, &config));
+    for (i = 0; i < 9; i++)
+    {
+        CHECK(pinPage(bm, h, requests[i]));
+        CHECK(unpinPage(bm, h));
+    }
+    CHECK(getPoolStats(bm, &stats));
+    for (i = 0, timed = 0; i < BM_LATENCY_BUCKETS; i++)
+        timed += stats.pinLatency[i];
+    ASSERT_EQUALS_INT(9, (int)timed, "nine pins timed");
+    ASSERT_EQUALS_INT(9, (int)(stats.hits + stats.misses), "and nine pins counted");
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    TEST_DONE();
+}
+
+// test tracing: the file starts with BM_TRACE_MAGIC and holds one
+// little-endian record per successful pin and unpin, batch pins included,
+// in call order
+void
+testTraceRoundTrip (void)
+{
+    const uint32_t expected[] = {
+        3 << 1, 300 << 1, 3 << 1 | BM_TRACE_UNPIN,
+        7 << 1, 3 << 1,
+        7 << 1 | BM_TRACE_UNPIN, 3 << 1 | BM_TRACE_UNPIN, 300 << 1 | BM_TRACE_UNPIN
+    };
+    const PageNumber batch[] = { 7, 3 };
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle *held = MAKE_PAGE_HANDLE();
+    BM_PageHandle handles[2];
+    BM_PoolConfig config = { .traceFile = "testbuffer.trace" };
+    unsigned char raw[64];
+    size_t len;
+    FILE *fp;
+    int i, wrong = 0;
+    testName = "Testing trace recording";
+
+    createDummyPages(bm, 301);
+    CHECK(initBufferPoolWithConfig(bm, "testbuffer.bin", 4, RS_LRU, NULL, &config));
+    CHECK(pinPage(bm, h, 3));
+    CHECK(pinPage(bm, held, 300));
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPages(bm, handles, batch, 2));
+    CHECK(unpinPage(bm, &handles[0]));
+    CHECK(unpinPage(bm, &handles[1]));
+    ASSERT_ERROR(pinPage(bm, h, -1), "a failed pin is not recorded");
+    CHECK(unpinPage(bm, held));
+    CHECK(shutdownBufferPool(bm));
+
+    fp = fopen("testbuffer.trace", "rb");
+    ASSERT_TRUE(fp != NULL, "trace written at shutdown");
+    len = fread(raw, 1, sizeof(raw), fp);
+    fclose(fp);
+    ASSERT_EQUALS_INT(8 + 8 * 4, (int)len, "header and eight records");
+    ASSERT_TRUE(memcmp(raw, BM_TRACE_MAGIC, 8) == 0, "file starts with BMTRACE1");
+    for (i = 0; i < 8; i++)
+    {
+        unsigned char *r = raw + 8 + 4 * i;
+        uint32_t record = r[0] | r[1] << 8 | r[2] << 16 | (uint32_t)r[3] << 24;
+        wrong += record != expected[i];
+    }
+    ASSERT_EQUALS_INT(0, wrong, "pins and unpins in call order");
+    ASSERT_TRUE(raw[8 + 4] == 0x58 && raw[8 + 5] == 0x02, "records are little-endian");
+
+    remove("testbuffer.trace");
+    CHECK(destroyPageFile("testbuffer.bin"));
+
+    free(bm);
+    free(h);
+    free(held);
+    TEST_DONE();
+}
@@ -0,0 +1,164 @@
+#include "record_mgr.h"
+#include "expr.h"
+#include "tables.h"
+#include "dberror.h"
+#include "test_helper.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// var to store the current test's name
+char *testName;
+
+#define TABLE_NAME "test_table_r.bin"
+
+// test and helper methods
+static Schema *testSchema (void);
+static Record *makeRecord (Schema *schema, int a, char *b);
+
+static void testInsertErrorReleasesPage (void);
+static void testScanSharedLatch (void);
+
+// main method
+int
+main (void)
+{
+  testName = "";
+
+  initRecordManager(NULL);
+
+  testInsertErrorReleasesPage();
+  testScanSharedLatch();
+
+  return 0;
+}
+
+// two attributes, an int and a 4-byte string
+Schema *
+testSchema (void)
+{
+  char **names = malloc(sizeof(char *) * 2);
+  DataType *types = malloc(sizeof(DataType) * 2);
+  int *sizes = malloc(sizeof(int) * 2);
+  int *keys = malloc(sizeof(int));
+
+  names[0] = "a";
+  names[1] = "b";
+  types[0] = DT_INT;
+  types[1] = DT_STRING;
+  sizes[0] = 0;
+  sizes[1] = 4;
+  keys[0] = 0;
+  return createSchema(2, names, types, sizes, 1, keys);
+}
+
+Record *
+makeRecord (Schema *schema, int a, char *b)
+{
+  Record *r;
+  Value *v;
+
+  TEST_CHECK(createRecord(&r, schema));
+  MAKE_VALUE(v, DT_INT, a);
+  TEST_CHECK(setAttr(r, schema, 0, v));
+  freeVal(v);
+  MAKE_STRING_VALUE(v, b);
+  TEST_CHECK(setAttr(r, schema, 1, v));
+  freeVal(v);
+  return r;
+}
+
+// A failed insert must not keep the page pinned or latched: getRecord
+// takes a shared latch on the same page and would wait forever behind a
+// leaked exclusive one.
+void
+testInsertErrorReleasesPage (void)
+{
+  RM_TableData table, noAttrs;
+  Schema *schema = testSchema();
+  Schema empty = *schema;
+  Record *r = makeRecord(schema, 1, "aaaa");
+  Record *bad = makeRecord(schema, 2, "bbbb");
+  Record *out;
+  Value *v;
+
+  testName = "test a failed insert releases its page";
+
+  TEST_CHECK(createTable(TABLE_NAME, schema));
+  TEST_CHECK(openTable(&table, TABLE_NAME));
+  table.schema = schema;
+  TEST_CHECK(insertRecord(&table, r));
+  ASSERT_EQUALS_INT(1, r->id.page, "record on page 1");
+
+  // same table, but a schema whose records have no bytes
+  empty.numAttr = 0;
+  noAttrs = table;
+  noAttrs.schema = &empty;
+  ASSERT_ERROR(insertRecord(&noAttrs, bad), "insert with an empty schema fails");
+
+  TEST_CHECK(createRecord(&out, schema));
+  TEST_CHECK(getRecord(&table, r->id, out));
+  TEST_CHECK(getAttr(out, schema, 0, &v));
+  ASSERT_EQUALS_INT(1, v->v.intV, "record still readable after the failed insert");
+  freeVal(v);
+
+  // and the page can still be latched exclusively
+  TEST_CHECK(insertRecord(&table, bad));
+  ASSERT_EQUALS_INT(1, bad->id.page, "next insert lands on page 1 too");
+
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(deleteTable(TABLE_NAME));
+  freeRecord(r);
+  freeRecord(bad);
+  freeRecord(out);
+  TEST_DONE();
+}
+
+// A scan holds a shared latch on the page it reads; updates between
+// calls to next see the page released again.
+void
+testScanSharedLatch (void)
+{
+  RM_TableData table;
+  RM_ScanHandle scan;
+  Schema *schema = testSchema();
+  Record *r[3], *out;
+  Value *v;
+  Expr *sel, *left, *right;
+  int found = 0;
+
+  testName = "test scans latch the pages they read";
+
+  TEST_CHECK(createTable(TABLE_NAME, schema));
+  TEST_CHECK(openTable(&table, TABLE_NAME));
+  table.schema = schema;
+  for (int i = 0; i < 3; i++) {
+    r[i] = makeRecord(schema, i, "cccc");
+    TEST_CHECK(insertRecord(&table, r[i]));
+  }
+
+  MAKE_CONS(left, stringToValue("i1"));
+  MAKE_ATTRREF(right, 0);
+  MAKE_BINOP_EXPR(sel, left, right, OP_COMP_SMALLER);
+  TEST_CHECK(createRecord(&out, schema));
+  TEST_CHECK(startScan(&table, &scan, sel));
+  while (next(&scan, out) == RC_OK) {
+    TEST_CHECK(getAttr(out, schema, 0, &v));
+    ASSERT_EQUALS_INT(2, v->v.intV, "scan returns the matching record");
+    freeVal(v);
+    // the scan released the page, so the update can latch it exclusively
+    TEST_CHECK(updateRecord(&table, out));
+    found++;
+  }
+  TEST_CHECK(closeScan(&scan));
+  ASSERT_EQUALS_INT(1, found, "one record matches");
+
+  TEST_CHECK(closeTable(&table));
+  TEST_CHECK(deleteTable(TABLE_NAME));
+  for (int i = 0; i < 3; i++)
+    freeRecord(r[i]);
+  freeRecord(out);
+  freeExpr(sel);
+  TEST_DONE();
+}